@@ -1,6 +1,7 @@
+#include <algorithm>
 #include <boost/log/trivial.hpp>
 #include <fstream>
-#include <future>
+#include <iterator>
 #include <limits>
 #include <numeric>
 #include <sstream>
@@ -32,8 +33,10 @@ auto parse_mappings(std::vector<Mapping> &map, std::istream &input) {
   auto range = size_t{};
   while (true) {
     std::getline(input, line);
-    if (line.empty())
+    if (line.empty()) {
+      std::sort(map.begin(), map.end());
       return;
+    }
     auto ss = std::stringstream{line};
     ss >> dest >> source >> range;
     map.push_back({dest, source, range});
@@ -90,52 +93,58 @@ auto operator<(const Range &a, const Range &b) {
   return a.low < b.low;
 }
 
-auto part2(const Input &input) {
-  auto ranges = std::vector<Range>{};
-  for (auto i = size_t{}; i < input.seeds.size(); i += 2) {
-    auto lower = input.seeds.at(i);
-    auto upper = lower + input.seeds.at(i + 1);
-    ranges.push_back({lower, upper});
+auto coalesce(std::vector<Range> &ranges) {
+  std::sort(ranges.begin(), ranges.end());
+  auto out = ranges.begin();
+  for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+    if (it->low == it->high)
+      continue;
+    if (out != ranges.begin() && std::prev(out)->high >= it->low)
+      std::prev(out)->high = std::max(std::prev(out)->high, it->high);
+    else
+      *out++ = *it;
   }
-  for (auto mapping : input.mappings) {
-    std::sort(ranges.begin(), ranges.end());
-    std::sort(mapping.begin(), mapping.end());
-    auto partials = std::vector<Range>{};
-    std::swap(partials, ranges);
-    while (!partials.empty()) {
-      auto sut = partials.back();
-      partials.pop_back();
-      for (auto &section : mapping) {
-        if (sut.low > section.source + section.range)
-          continue;
-        if (sut.high < section.source) {
-          ranges.push_back(sut);
-          goto next_partial;
-        }
-        if (sut.low < section.source && sut.high > section.source) {
-          ranges.push_back({sut.low, section.source - 1});
-          partials.push_back({section.source, sut.high});
-          goto next_partial;
-        }
-        if (sut.low >= section.source && sut.high < section.source + section.range) {
-          ranges.push_back({section.dest - section.source + sut.low,
-                            section.dest - section.source + sut.high});
-          goto next_partial;
-        }
-        if (sut.low >= section.source && sut.high > section.source + section.range) {
-          ranges.push_back(
-              {section.dest - section.source + sut.low, section.dest + section.range});
-          partials.push_back({section.source + section.range + 1, sut.high});
-          goto next_partial;
-        }
+  ranges.erase(out, ranges.end());
+}
+
+auto apply_layer(const std::vector<Range> &ranges, const std::vector<Mapping> &layer) {
+  auto rval = std::vector<Range>{};
+  rval.reserve(ranges.size() + layer.size());
+  auto section = layer.begin();
+  for (auto [low, high] : ranges) {
+    while (low < high) {
+      while (section != layer.end() && section->source + section->range <= low)
+        ++section;
+      if (section == layer.end() || high <= section->source) {
+        rval.push_back({low, high});
+        break;
       }
-      ranges.push_back(sut);
-    next_partial:
-      continue;
+      if (low < section->source) {
+        rval.push_back({low, section->source});
+        low = section->source;
+      }
+      auto end = std::min(high, section->source + section->range);
+      rval.push_back(
+          {section->dest + low - section->source, section->dest + end - section->source});
+      low = end;
     }
   }
-  std::sort(ranges.begin(), ranges.end());
-  return ranges.front().low - 1;
+  coalesce(rval);
+  return rval;
+}
+
+auto part2(const Input &input) {
+  auto ranges = std::vector<Range>{};
+  for (auto i = size_t{}; i + 1 < input.seeds.size(); i += 2) {
+    auto lower = input.seeds.at(i);
+    ranges.push_back({lower, lower + input.seeds.at(i + 1)});
+  }
+  coalesce(ranges);
+  for (const auto &layer : input.mappings)
+    ranges = apply_layer(ranges, layer);
+  if (ranges.empty())
+    throw std::runtime_error{"no seeds"};
+  return ranges.front().low;
 }
 
 } // namespace
@@ -1,47 +1,95 @@
 #include <boost/log/trivial.hpp>
+#include <cmath>
 #include <cstdint>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 namespace {
 
 using Size = uint64_t;
+using Wide = unsigned __int128;
 using Parse = std::vector<std::pair<Size, Size>>;
 
-auto test = Parse{{7, 9}, {15, 40}, {30, 200}};
-auto test2 = Parse{{71530, 940200}};
+struct Races {
+  Parse races{};
+  Parse kerned{};
+};
 
-auto puzz = Parse{{47, 282}, {70, 1079}, {75, 1147}, {66, 1062}};
-auto puzz2 = Parse{{47707566, 282107911471062}};
+auto parse_line(std::istream &input_handle, Parse &races, bool first, Size &kerned) {
+  auto line = std::string{};
+  if (!std::getline(input_handle, line))
+    throw std::runtime_error{"short input"};
+  auto ss = std::stringstream{line.substr(line.find(':') + 1)};
+  auto number = std::string{};
+  auto digits = std::string{};
+  for (auto i = size_t{}; ss >> number; ++i) {
+    auto value = Size{std::stoull(number)};
+    if (first)
+      races.push_back({value, 0});
+    else
+      races.at(i).second = value;
+    digits += number;
+  }
+  kerned = std::stoull(digits);
+}
+
+auto parse(const std::string &filename) {
+  auto rval = Races{};
+  auto input_handle = std::ifstream{filename};
+  if (!input_handle)
+    throw std::runtime_error{"could not open file"};
+  auto time = Size{};
+  auto distance = Size{};
+  parse_line(input_handle, rval.races, true, time);
+  parse_line(input_handle, rval.races, false, distance);
+  rval.kerned.push_back({time, distance});
+  return rval;
+}
+
+auto isqrt(Wide n) {
+  auto r = Wide(std::sqrt(static_cast<long double>(n)));
+  while (r > 0 && r > n / r)
+    --r;
+  while (r + 1 <= n / (r + 1))
+    ++r;
+  return r;
+}
+
+auto wins(Wide time, Wide record, Wide charge) {
+  return (time - charge) * charge > record;
+}
+
+auto count_wins(Size time, Size record) {
+  auto t = Wide{time};
+  auto d = Wide{record};
+  if (t * t < 4 * d)
+    return Size{};
+  auto charge = (t - isqrt(t * t - 4 * d)) / 2;
+  while (charge > 0 && wins(t, d, charge - 1))
+    --charge;
+  while (charge <= t / 2 && !wins(t, d, charge))
+    ++charge;
+  if (charge > t / 2)
+    return Size{};
+  return Size(t - 2 * charge + 1);
+}
 
 auto find_distance_combos(const Parse &input) {
   auto rval = Size{1};
-  for (auto &p : input) {
-    auto firstwin = Size{};
-    auto lastwin = Size{};
-    for (auto charge = Size{1}; charge < p.first; ++charge) {
-      auto distance = (p.first - charge) * charge;
-      if (distance > p.second) {
-        if (!firstwin)
-          firstwin = charge;
-        lastwin = charge;
-      } else {
-        if (firstwin)
-          break;
-      }
-    }
-    rval *= (lastwin - firstwin + 1);
-  }
+  for (auto &p : input)
+    rval *= count_wins(p.first, p.second);
   return rval;
 }
 
 } // namespace
 
 auto main() -> int {
-  BOOST_LOG_TRIVIAL(info) << "Part 1: " << find_distance_combos(puzz);  // 281600
-  BOOST_LOG_TRIVIAL(info) << "Part 2: " << find_distance_combos(puzz2); // 33875953
+  BOOST_LOG_TRIVIAL(debug) << "Starting up";
+  auto input = parse("input/06.txt");
+  BOOST_LOG_TRIVIAL(debug) << "Input parsed";
+  BOOST_LOG_TRIVIAL(info) << "Part 1: " << find_distance_combos(input.races);  // 281600
+  BOOST_LOG_TRIVIAL(info) << "Part 2: " << find_distance_combos(input.kerned); // 33875953
 }
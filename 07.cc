@@ -1,10 +1,10 @@
-#include <algorithm>
+#include <array>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
-#include <sstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 namespace {
@@ -12,96 +12,124 @@ namespace {
 enum class Type { Five, Four, FullHouse, Three, TwoPair, Pair, High };
 
 struct Hand {
-  std::string cards;
   int bid;
-  Type type;
-  Type type2;
+  uint32_t key;
+  uint32_t key2;
 };
 
 using Hands = std::vector<Hand>;
+using Counts = std::array<int, 13>;
 
-constexpr auto value_for_label(char label, bool jokers) {
-  if (label >= '0' && label <= '9')
-    return label - '0';
-  else if (label == 'T')
-    return 10;
-  else if (label == 'J')
-    return jokers ? -1 : 11;
-  else if (label == 'Q')
-    return 12;
-  else if (label == 'K')
-    return 13;
-  else if (label == 'A')
-    return 14;
-  throw std::runtime_error{"bad card"};
-}
+constexpr auto labels = std::string_view{"23456789TJQKA"};
+constexpr auto joker = int(labels.find('J'));
 
-auto count_cards(const std::string &cards) {
-  auto rval = std::unordered_map<int, int>{};
-  for (auto card : cards)
-    ++rval[value_for_label(card, false)];
-  return rval;
+constexpr auto value_for_label(char label) {
+  auto value = labels.find(label);
+  if (value == labels.npos)
+    throw std::runtime_error{"bad card"};
+  return int(value);
 }
 
-auto type_for_count(const std::unordered_map<int, int> &count, bool jokers) {
-  auto joker_count = jokers && count.contains(11) ? count.at(11) : 0;
-
-  auto highest = std::vector<int>{};
-  for (const auto &pair : count)
-    highest.push_back(jokers && pair.first == 11 ? 0 : pair.second);
-  std::sort(highest.rbegin(), highest.rend());
+constexpr auto joker_value(int value) {
+  return value == joker ? 0 : value < joker ? value + 1 : value;
+}
 
-  if (highest[0] + joker_count >= 5)
+constexpr auto classify(int first, int second, int joker_count) {
+  if (first + joker_count >= 5)
     return Type::Five;
-  if (highest[0] + joker_count >= 4)
+  if (first + joker_count >= 4)
     return Type::Four;
-  if (highest[0] + highest[1] + joker_count >= 5)
+  if (first + second + joker_count >= 5)
     return Type::FullHouse;
-  if (highest[0] + joker_count >= 3)
+  if (first + joker_count >= 3)
     return Type::Three;
-  if (highest[0] + highest[1] + joker_count >= 4)
+  if (first + second + joker_count >= 4)
     return Type::TwoPair;
-  if (highest[0] + joker_count >= 2)
+  if (first + joker_count >= 2)
     return Type::Pair;
   return Type::High;
 }
 
+// The sum of squared label counts is unique for every multiset of counts over
+// at most five cards, so it indexes the type directly alongside the joker count.
+constexpr auto type_table = [] {
+  auto rval = std::array<std::array<Type, 26>, 6>{};
+  for (auto joker_count = 0; joker_count <= 5; ++joker_count) {
+    auto n = 5 - joker_count;
+    for (auto a = 0; a <= n; ++a)
+      for (auto b = 0; b <= a && a + b <= n; ++b)
+        for (auto c = 0; c <= b && a + b + c <= n; ++c)
+          for (auto d = 0; d <= c && a + b + c + d <= n; ++d) {
+            auto e = n - a - b - c - d;
+            if (e <= d)
+              rval[joker_count][a * a + b * b + c * c + d * d + e * e] =
+                  classify(a, b, joker_count);
+          }
+  }
+  return rval;
+}();
+
+constexpr auto type_shift = 20;
+
+auto pack_key(Type type, const std::array<int, 5> &values) {
+  auto rval = uint32_t(int(Type::High) - int(type));
+  for (auto value : values)
+    rval = (rval << 4) | uint32_t(value);
+  return rval;
+}
+
 auto parse(const std::string &filename) {
   auto rval = Hands{};
   auto input_handle = std::ifstream{filename};
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
-  auto line = std::string{};
   auto hand = std::string{};
   auto bid = int{};
   while (input_handle >> hand >> bid) {
-    auto count = count_cards(hand);
-    rval.push_back({hand, bid, type_for_count(count, false), type_for_count(count, true)});
+    if (hand.size() != 5)
+      throw std::runtime_error{"bad hand"};
+    auto count = Counts{};
+    auto squares = 0;
+    auto values = std::array<int, 5>{};
+    auto values2 = std::array<int, 5>{};
+    for (auto i = 0; i < 5; ++i) {
+      values[i] = value_for_label(hand[i]);
+      values2[i] = joker_value(values[i]);
+      squares += 2 * count[values[i]]++ + 1;
+    }
+    auto joker_count = count[joker];
+    rval.push_back({bid, pack_key(type_table[0][squares], values),
+                    pack_key(type_table[joker_count][squares - joker_count * joker_count],
+                             values2)});
   }
   return rval;
 }
 
-auto compare_hand_rank(const Hand &a, const Hand &b, bool jokers) {
-  if (!jokers && a.type != b.type)
-    return a.type > b.type;
-  if (jokers && a.type2 != b.type2)
-    return a.type2 > b.type2;
-  for (auto i = 0; i < 5; ++i) {
-    auto a_value = value_for_label(a.cards[i], jokers);
-    auto b_value = value_for_label(b.cards[i], jokers);
-    if (a_value != b_value)
-      return a_value < b_value;
+auto radix_sort(std::vector<uint64_t> &items) {
+  constexpr auto digit = 8;
+  constexpr auto key_bits = type_shift + 3;
+  auto scratch = std::vector<uint64_t>(items.size());
+  for (auto shift = 32; shift < 32 + key_bits; shift += digit) {
+    auto buckets = std::array<size_t, (1 << digit) + 1>{};
+    for (auto item : items)
+      ++buckets[((item >> shift) & 0xff) + 1];
+    for (auto i = size_t{1}; i < buckets.size(); ++i)
+      buckets[i] += buckets[i - 1];
+    for (auto item : items)
+      scratch[buckets[(item >> shift) & 0xff]++] = item;
+    std::swap(items, scratch);
   }
-  throw std::runtime_error{"mismatch"};
 }
 
-auto rank_and_score(Hands hands, bool jokers) {
-  std::sort(hands.begin(), hands.end(), [jokers](Hand &a, Hand &b) {
-    return compare_hand_rank(a, b, jokers);
-  });
-  auto rval = 0;
-  for (auto rank = size_t{}; rank < hands.size(); ++rank)
-    rval += (rank + 1) * hands[rank].bid;
+auto rank_and_score(const Hands &hands, bool jokers) {
+  auto items = std::vector<uint64_t>{};
+  items.reserve(hands.size());
+  for (const auto &hand : hands)
+    items.push_back(uint64_t(jokers ? hand.key2 : hand.key) << 32 | uint32_t(hand.bid));
+  radix_sort(items);
+  auto rval = size_t{};
+  for (auto rank = size_t{}; rank < items.size(); ++rank)
+    rval += (rank + 1) * (items[rank] & 0xffffffff);
   return rval;
 }
 
@@ -1,23 +1,46 @@
 #include <algorithm>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
-#include <functional>
+#include <limits>
 #include <numeric>
+#include <optional>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 namespace {
 
-struct Step {
-  std::string left;
-  std::string right;
-};
+using Node = uint16_t;
+
+constexpr auto radix = 36;
+constexpr auto node_count = radix * radix * radix;
+
+constexpr auto digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 10;
+  throw std::runtime_error{"bad node name"};
+}
+
+constexpr auto intern(std::string_view name) {
+  return Node(digit(name[0]) * radix * radix + digit(name[1]) * radix + digit(name[2]));
+}
+
+constexpr auto ends_with(Node node, char c) {
+  return node % radix == digit(c);
+}
 
 struct Desert {
-  std::string path;
-  std::unordered_map<std::string, Step> steps;
+  std::vector<bool> path{};
+  std::vector<Node> left = std::vector<Node>(node_count);
+  std::vector<Node> right = std::vector<Node>(node_count);
+  std::vector<bool> defined = std::vector<bool>(node_count);
+  std::vector<Node> nodes{};
 };
 
 auto parse(const std::string &filename) {
@@ -26,48 +49,234 @@ auto parse(const std::string &filename) {
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
   auto line = std::string{};
-  auto s = std::string{};
-  std::getline(input_handle, rval.path);
-  std::getline(input_handle, s);
+  std::getline(input_handle, line);
+  for (auto c : line)
+    rval.path.push_back(c == 'R');
+  std::getline(input_handle, line);
   while (std::getline(input_handle, line)) {
-    auto src = line.substr(0, 3);
-    auto left = line.substr(7, 3);
-    auto right = line.substr(12, 3);
-    rval.steps.insert({src, {left, right}});
+    if (line.size() < 15)
+      continue;
+    auto view = std::string_view{line};
+    auto src = intern(view.substr(0, 3));
+    rval.left[src] = intern(view.substr(7, 3));
+    rval.right[src] = intern(view.substr(12, 3));
+    rval.defined[src] = true;
+    rval.nodes.push_back(src);
   }
+  for (auto node : rval.nodes)
+    if (!rval.defined[rval.left[node]] || !rval.defined[rval.right[node]])
+      throw std::runtime_error{"undefined node"};
   return rval;
 }
 
-auto walk(const Desert &input, std::string start, std::function<bool(std::string)> dest) {
-  auto step = 0;
-  auto place = std::move(start);
+template <typename F>
+auto walk(const Desert &input, Node place, F dest) {
+  auto step = size_t{};
+  auto index = size_t{};
+  const auto *left = input.left.data();
+  const auto *right = input.right.data();
   while (!dest(place)) {
-    auto next = input.path[step % input.path.size()];
-    if (next == 'L')
-      place = input.steps.at(place).left;
-    else
-      place = input.steps.at(place).right;
+    place = input.path[index] ? right[place] : left[place];
+    if (++index == input.path.size())
+      index = 0;
     ++step;
   }
   return step;
 }
 
 auto part1(const Desert &input) {
-  return walk(input, "AAA", [](const std::string &place) {
-    return place == "ZZZ";
+  constexpr auto aaa = intern("AAA");
+  constexpr auto zzz = intern("ZZZ");
+  if (!input.defined[aaa] || !input.defined[zzz])
+    throw std::runtime_error{"undefined node"};
+  return walk(input, aaa, [](Node place) {
+    return place == zzz;
   });
 }
 
-auto part2(const Desert &input) {
-  auto loops = std::vector<size_t>{};
-  for (auto &step : input.steps)
-    if (step.first.at(2) == 'A')
-      loops.push_back(walk(input, step.first, [](const std::string &place) {
-        return place.at(2) == 'Z';
-      }));
-  return std::reduce(loops.begin(), loops.end(), size_t{1}, [](size_t a, size_t b) {
-    return std::lcm(a, b);
+// One block is a full traversal of the path. next maps each node to where a
+// block starting there ends, hits records the offsets into the block that land
+// on a Z node, and jump[j] is next applied 2^j times.
+struct Blocks {
+  std::vector<Node> next = std::vector<Node>(node_count);
+  std::vector<std::vector<size_t>> hits = std::vector<std::vector<size_t>>(node_count);
+  std::vector<std::vector<Node>> jump{};
+};
+
+auto build_blocks(const Desert &input) {
+  auto rval = Blocks{};
+  std::iota(rval.next.begin(), rval.next.end(), Node{});
+  for (auto node : input.nodes) {
+    auto place = node;
+    for (auto i = size_t{}; i < input.path.size(); ++i) {
+      if (ends_with(place, 'Z'))
+        rval.hits[node].push_back(i);
+      place = input.path[i] ? input.right[place] : input.left[place];
+    }
+    rval.next[node] = place;
+  }
+  rval.jump.push_back(rval.next);
+  for (auto limit = size_t{1}; limit <= 2 * input.nodes.size(); limit *= 2) {
+    const auto &last = rval.jump.back();
+    auto doubled = std::vector<Node>(node_count);
+    for (auto node = size_t{}; node < node_count; ++node)
+      doubled[node] = last[last[node]];
+    rval.jump.push_back(std::move(doubled));
+  }
+  return rval;
+}
+
+auto advance(const Blocks &blocks, Node place, size_t count) {
+  for (auto level = size_t{}; count; ++level, count >>= 1)
+    if (count & 1)
+      place = blocks.jump.at(level)[place];
+  return place;
+}
+
+// Z hits before tail steps are listed explicitly; from tail onwards the ghost
+// hits Z exactly at the steps congruent to one of residues modulo period.
+struct Ghost {
+  size_t tail;
+  size_t period;
+  std::vector<size_t> early{};
+  std::vector<size_t> residues{};
+};
+
+auto hits_at(const Ghost &ghost, size_t step) {
+  if (step < ghost.tail)
+    return std::binary_search(ghost.early.begin(), ghost.early.end(), step);
+  return std::binary_search(ghost.residues.begin(), ghost.residues.end(), step % ghost.period);
+}
+
+auto trace_ghost(const Desert &input, const Blocks &blocks, Node start) {
+  // Brent's algorithm for the cycle length in blocks.
+  auto power = size_t{1};
+  auto cycle = size_t{1};
+  auto tortoise = start;
+  auto hare = blocks.next[start];
+  while (tortoise != hare) {
+    if (power == cycle) {
+      tortoise = hare;
+      power *= 2;
+      cycle = 0;
+    }
+    hare = blocks.next[hare];
+    ++cycle;
+  }
+  // Binary search for the tail length using the jump tables.
+  auto low = size_t{};
+  auto high = input.nodes.size();
+  while (low < high) {
+    auto mid = (low + high) / 2;
+    auto place = advance(blocks, start, mid);
+    if (place == advance(blocks, place, cycle))
+      high = mid;
+    else
+      low = mid + 1;
+  }
+
+  auto length = input.path.size();
+  auto rval = Ghost{low * length, cycle * length};
+  auto place = start;
+  for (auto block = size_t{}; block < low + cycle; ++block) {
+    for (auto offset : blocks.hits[place]) {
+      auto step = block * length + offset;
+      if (block < low)
+        rval.early.push_back(step);
+      else
+        rval.residues.push_back(step % rval.period);
+    }
+    place = blocks.next[place];
+  }
+  std::sort(rval.residues.begin(), rval.residues.end());
+  return rval;
+}
+
+using Wide = __int128;
+using UWide = unsigned __int128;
+
+struct Congruence {
+  Wide residue;
+  Wide modulus;
+};
+
+auto inverse(Wide a, Wide m) {
+  auto [old_r, r] = std::pair{a, m};
+  auto [old_s, s] = std::pair{Wide{1}, Wide{0}};
+  while (r) {
+    auto q = old_r / r;
+    std::tie(old_r, r) = std::pair{r, old_r - q * r};
+    std::tie(old_s, s) = std::pair{s, old_s - q * s};
+  }
+  return ((old_s % m) + m) % m;
+}
+
+auto merge(const Congruence &a, const Congruence &b) -> std::optional<Congruence> {
+  auto g = std::gcd(a.modulus, b.modulus);
+  auto diff = b.residue - a.residue;
+  if (diff % g)
+    return std::nullopt;
+  auto m = b.modulus / g;
+  auto lcm = a.modulus * m;
+  if (lcm > Wide{std::numeric_limits<size_t>::max()})
+    throw std::overflow_error{"ghost period too long"};
+  auto x =
+      Wide(UWide(((diff / g) % m + m) % m) * UWide(inverse(a.modulus / g % m, m)) % UWide(m));
+  return Congruence{(a.residue + a.modulus * x) % lcm, lcm};
+}
+
+auto align(const std::vector<Ghost> &ghosts) {
+  auto rval = std::numeric_limits<size_t>::max();
+  auto latest = std::max_element(ghosts.begin(), ghosts.end(), [](auto &a, auto &b) {
+    return a.tail < b.tail;
   });
+  for (auto step : latest->early)
+    if (std::all_of(ghosts.begin(), ghosts.end(), [step](auto &ghost) {
+          return hits_at(ghost, step);
+        }))
+      return step;
+
+  auto congruences = std::vector<Congruence>{{0, 1}};
+  for (const auto &ghost : ghosts) {
+    auto merged = std::vector<Congruence>{};
+    for (const auto &c : congruences)
+      for (auto residue : ghost.residues)
+        if (auto m = merge(c, {Wide(residue), Wide(ghost.period)}))
+          merged.push_back(*m);
+    std::sort(merged.begin(), merged.end(), [](auto &a, auto &b) {
+      return a.residue < b.residue;
+    });
+    merged.erase(std::unique(merged.begin(), merged.end(),
+                             [](auto &a, auto &b) {
+                               return a.residue == b.residue;
+                             }),
+                 merged.end());
+    std::swap(congruences, merged);
+  }
+  if (congruences.empty())
+    throw std::runtime_error{"ghosts never align"};
+  auto tail = Wide(latest->tail);
+  for (const auto &c : congruences) {
+    auto step = c.residue;
+    if (step < tail)
+      step += (tail - step + c.modulus - 1) / c.modulus * c.modulus;
+    if (step <= Wide{std::numeric_limits<size_t>::max()})
+      rval = std::min(rval, size_t(step));
+  }
+  if (rval == std::numeric_limits<size_t>::max())
+    throw std::overflow_error{"ghosts align beyond size_t"};
+  return rval;
+}
+
+auto part2(const Desert &input) {
+  auto blocks = build_blocks(input);
+  auto ghosts = std::vector<Ghost>{};
+  for (auto node : input.nodes)
+    if (ends_with(node, 'A'))
+      ghosts.push_back(trace_ghost(input, blocks, node));
+  if (ghosts.empty())
+    throw std::runtime_error{"no ghosts"};
+  return align(ghosts);
 }
 
 } // namespace
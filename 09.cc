@@ -1,6 +1,7 @@
-#include <algorithm>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -8,7 +9,15 @@
 
 namespace {
 
-using Oasis = std::vector<std::vector<int>>;
+using Value = int64_t;
+
+// Sequences of one length, stored column-wise: columns[i][s] is the i'th
+// reading of sequence s.
+struct Batch {
+  std::vector<std::vector<Value>> columns{};
+};
+
+using Oasis = std::map<size_t, Batch>;
 
 auto parse(const std::string &filename) {
   auto rval = Oasis{};
@@ -16,39 +25,66 @@ auto parse(const std::string &filename) {
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
   auto line = std::string{};
+  auto readings = std::vector<Value>{};
   while (std::getline(input_handle, line)) {
     auto ss = std::stringstream{line};
-    rval.emplace_back();
-    auto i = int{};
+    readings.clear();
+    auto i = Value{};
     while (ss >> i)
-      rval.back().push_back(i);
+      readings.push_back(i);
+    if (readings.empty())
+      continue;
+    auto &batch = rval[readings.size()];
+    batch.columns.resize(readings.size());
+    for (auto j = size_t{}; j < readings.size(); ++j)
+      batch.columns[j].push_back(readings[j]);
   }
   return rval;
 }
 
-auto solve(const Oasis &sequences) {
-  auto part1 = 0;
-  auto part2 = 0;
-  for (const auto &sequence : sequences) {
-    auto ss = std::vector<std::vector<int>>{};
-    ss.push_back(sequence);
+// Newton's forward and backward formulas: the next and previous terms of a
+// sequence of length n are signed binomial sums of its n readings.
+struct Weights {
+  std::vector<Value> next{};
+  std::vector<Value> prev{};
+};
 
-    do {
-      ss.emplace_back();
-      auto &last = ss.at(ss.size() - 2);
-      for (auto i = size_t{}; i < last.size() - 1; ++i)
-        ss.back().push_back(last.at(i + 1) - last.at(i));
-    } while (!std::all_of(ss.back().begin(), ss.back().end(), [](auto a) {
-      return a == 0;
-    }));
+auto weights_for_length(size_t n) {
+  auto binomial = std::vector<Value>(n + 1);
+  binomial[0] = 1;
+  for (auto k = size_t{1}; k <= n; ++k)
+    binomial[k] = binomial[k - 1] * Value(n - k + 1) / Value(k);
+  auto rval = Weights{};
+  for (auto i = size_t{}; i < n; ++i) {
+    rval.next.push_back((n - 1 - i) % 2 ? -binomial[i] : binomial[i]);
+    rval.prev.push_back(i % 2 ? -binomial[i + 1] : binomial[i + 1]);
+  }
+  return rval;
+}
 
-    for (auto i = int(ss.size()) - 2; i >= 0; --i) {
-      ss.at(i).push_back(ss.at(i).back() + ss.at(i + 1).back());
-      ss.at(i).insert(ss.at(i).begin(), ss.at(i).front() - ss.at(i + 1).front());
+auto solve(const Oasis &sequences) {
+  auto part1 = Value{};
+  auto part2 = Value{};
+  auto next = std::vector<Value>{};
+  auto prev = std::vector<Value>{};
+  for (const auto &[length, batch] : sequences) {
+    auto weights = weights_for_length(length);
+    auto count = batch.columns.front().size();
+    next.assign(count, 0);
+    prev.assign(count, 0);
+    for (auto i = size_t{}; i < length; ++i) {
+      const auto *column = batch.columns[i].data();
+      auto wn = weights.next[i];
+      auto wp = weights.prev[i];
+      for (auto s = size_t{}; s < count; ++s) {
+        next[s] += wn * column[s];
+        prev[s] += wp * column[s];
+      }
+    }
+    for (auto s = size_t{}; s < count; ++s) {
+      part1 += next[s];
+      part2 += prev[s];
     }
-
-    part1 += ss.front().back();
-    part2 += ss.front().front();
   }
   BOOST_LOG_TRIVIAL(info) << "Part 1: " << part1   // 1819125966
                           << " Part 2: " << part2; // 1140
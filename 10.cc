@@ -1,47 +1,70 @@
 #include "point.h"
-#include <algorithm>
+#include <array>
+#include <bit>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <string_view>
 #include <vector>
 
 namespace {
 
-auto pipes = std::unordered_map<char, std::vector<Point>>{
-    {'|', {P::up, P::down}}, {'-', {P::left, P::right}}, {'L', {P::up, P::right}},
-    {'J', {P::left, P::up}}, {'7', {P::left, P::down}},  {'F', {P::right, P::down}},
-};
+enum Direction : uint8_t { North = 1, East = 2, South = 4, West = 8 };
+
+constexpr auto opposite(uint8_t direction) {
+  return uint8_t(direction < 4 ? direction << 2 : direction >> 2);
+}
+
+constexpr auto pipes = [] {
+  auto rval = std::array<uint8_t, 256>{};
+  rval['|'] = North | South;
+  rval['-'] = East | West;
+  rval['L'] = North | East;
+  rval['J'] = North | West;
+  rval['7'] = South | West;
+  rval['F'] = South | East;
+  return rval;
+}();
+
+auto step(uint8_t direction) {
+  switch (direction) {
+  case North:
+    return P::up;
+  case East:
+    return P::right;
+  case South:
+    return P::down;
+  default:
+    return P::left;
+  }
+}
 
+// One byte per cell holding the directions its pipe connects to.
 struct Maze {
   Point start;
-  std::unordered_map<Point, char> pieces{};
+  std::vector<uint8_t> pieces{};
   int xmax;
   int ymax;
-};
 
-auto goes(const std::vector<Point> &points, const Point &direction) {
-  return points.at(0) == direction || points.at(1) == direction;
-}
-
-auto find_start(const Maze &input) {
-  auto start = std::vector<Point>{};
-  for (auto &adjacent : std::vector{P::up, P::down, P::left, P::right}) {
-    auto test = input.start + adjacent;
-    if (!input.pieces.contains(test))
-      continue;
-    auto backwards = Point{} - adjacent;
-    if (goes(pipes.at(input.pieces.at(test)), backwards))
-      start.push_back(adjacent);
+  auto at(const Point &p) const -> uint8_t {
+    if (p.x < 0 || p.y < 0 || p.x >= xmax || p.y >= ymax)
+      return 0;
+    return pieces[size_t(p.y) * size_t(xmax) + size_t(p.x)];
   }
-  if (start.size() != 2)
+};
+
+template <typename Grid>
+auto find_start(Grid &input) {
+  auto rval = uint8_t{};
+  for (auto direction : {North, East, South, West})
+    if (input.at(input.start + step(direction)) & opposite(direction))
+      rval |= direction;
+  if (std::popcount(rval) != 2)
     throw std::runtime_error{"bad start"};
-  for (auto &pipe : pipes)
-    if (std::is_permutation(pipe.second.begin(), pipe.second.end(), start.begin(), start.end()))
-      return pipe.first;
-  throw std::runtime_error{"couldn't decide where we started"};
+  return rval;
 }
 
 auto parse(const std::string &filename) {
@@ -49,84 +72,192 @@ auto parse(const std::string &filename) {
   auto input_handle = std::ifstream{filename};
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
+  auto lines = std::vector<std::string>{};
   auto line = std::string{};
-  auto y = 0;
   while (std::getline(input_handle, line)) {
     rval.xmax = std::max(rval.xmax, int(line.size()));
-    for (auto x = 0; x < rval.xmax; ++x) {
-      auto ps = line.at(x);
-      if (ps == '.')
-        continue;
-      if (ps == 'S')
+    lines.push_back(line);
+  }
+  rval.ymax = int(lines.size());
+  rval.pieces.resize(size_t(rval.xmax) * size_t(rval.ymax));
+  auto found = false;
+  for (auto y = 0; y < rval.ymax; ++y)
+    for (auto x = 0; x < int(lines[y].size()); ++x) {
+      auto ps = lines[y][x];
+      if (ps == 'S') {
         rval.start = Point{x, y};
-      else
-        rval.pieces.insert({Point{x, y}, ps});
+        found = true;
+      }
+      rval.pieces[size_t(y) * size_t(rval.xmax) + size_t(x)] = pipes[uint8_t(ps)];
+    }
+  if (!found)
+    throw std::runtime_error{"no start"};
+  rval.pieces[size_t(rval.start.y) * size_t(rval.xmax) + size_t(rval.start.x)] = find_start(rval);
+  return rval;
+}
+
+// The maze file read a row at a time on demand through a small direct-mapped
+// cache. The trace only ever moves one row at a time, so it needs a few
+// hundred rows of text rather than the whole grid.
+struct RowCache {
+  std::ifstream handle;
+  std::streamoff stride{};
+  Point start{};
+  uint8_t start_pipe{};
+  int xmax{};
+  int ymax{};
+  std::vector<std::string> rows = std::vector<std::string>(256);
+  std::vector<int> loaded = std::vector<int>(256, -1);
+
+  auto at(const Point &p) -> uint8_t {
+    if (p.x < 0 || p.y < 0 || p.x >= xmax || p.y >= ymax)
+      return 0;
+    if (p == start)
+      return start_pipe;
+    auto slot = size_t(p.y) % rows.size();
+    if (loaded[slot] != p.y) {
+      handle.clear();
+      handle.seekg(stride * p.y);
+      rows[slot].resize(size_t(xmax));
+      if (!handle.read(rows[slot].data(), xmax))
+        throw std::runtime_error{"maze changed underfoot"};
+      loaded[slot] = p.y;
+    }
+    return pipes[uint8_t(rows[slot][size_t(p.x)])];
+  }
+};
+
+// A first pass over the file for its shape and the start; nothing is kept.
+auto scan(const std::string &filename) {
+  auto rval = RowCache{std::ifstream{filename}};
+  if (!rval.handle)
+    throw std::runtime_error{"could not open file"};
+  auto line = std::string{};
+  auto found = false;
+  for (; std::getline(rval.handle, line); ++rval.ymax) {
+    if (!rval.ymax) {
+      rval.xmax = int(line.size());
+      rval.stride = rval.handle.tellg();
+    } else if (int(line.size()) != rval.xmax)
+      throw std::runtime_error{"ragged maze"};
+    if (auto x = line.find('S'); x != std::string::npos) {
+      rval.start = Point{int(x), rval.ymax};
+      found = true;
     }
-    ++y;
   }
-  rval.ymax = y;
-  rval.pieces.insert({rval.start, find_start(rval)});
+  if (!found)
+    throw std::runtime_error{"no start"};
+  rval.start_pipe = find_start(rval);
   return rval;
 }
 
-auto find_next(const Maze &input, const Point &last, const std::unordered_set<Point> &been) {
-  auto ps = input.pieces.at(last);
-  for (auto &n : pipes.at(ps)) {
-    auto next = last + n;
-    if (!been.contains(next) && input.pieces.contains(next))
-      return next;
+// One bit per cell marking loop membership, each row padded to whole words.
+struct Bitmap {
+  size_t words;
+  std::vector<uint64_t> bits;
+
+  Bitmap(int width, int height)
+      : words{(size_t(width) + 63) / 64}, bits(words * size_t(height)) {}
+
+  auto set(const Point &p) {
+    bits[size_t(p.y) * words + size_t(p.x) / 64] |= uint64_t{1} << (p.x % 64);
+  }
+
+  auto row(int y) const {
+    return bits.data() + size_t(y) * words;
   }
-  return input.start;
+};
+
+struct Loop {
+  size_t length;
+  size_t inside;
+};
+
+// Follow the pipes from the start, accumulating the shoelace sum over the
+// corners only; Pick's theorem then gives the enclosed cell count.
+template <typename Grid>
+auto trace_loop(Grid &input, Bitmap *membership = nullptr) {
+  auto length = size_t{};
+  auto area = int64_t{};
+  auto corner = input.start;
+  auto here = input.start;
+  auto direction = uint8_t(input.at(here) & -input.at(here));
+  do {
+    here += step(direction);
+    ++length;
+    if (membership)
+      membership->set(here);
+    auto exits = uint8_t(input.at(here) & ~opposite(direction));
+    if (exits != direction) {
+      area += int64_t(corner.x) * here.y - int64_t(here.x) * corner.y;
+      corner = here;
+      direction = exits;
+    }
+  } while (here != input.start);
+  area = std::abs(area + int64_t(corner.x) * here.y - int64_t(here.x) * corner.y);
+  return Loop{length, size_t((area - int64_t(length)) / 2 + 1)};
 }
 
-auto count_inside(const Maze &input, const std::unordered_set<Point> &loop) {
+auto prefix_xor(uint64_t word) {
+  for (auto shift = 1; shift < 64; shift *= 2)
+    word ^= word << shift;
+  return word;
+}
+
+// Re-read the maze a row at a time and count cells inside the loop by
+// crossing parity, 64 cells per word. Only pipes connecting north toggle
+// parity, which handles horizontal runs without tracking the turn pairs.
+auto count_inside_streaming(const std::string &filename, const Point &start, uint8_t start_pipe,
+                            int width, const Bitmap &membership) {
+  auto input_handle = std::ifstream{filename};
+  if (!input_handle)
+    throw std::runtime_error{"could not open file"};
+  auto crossing = std::vector<uint64_t>(membership.words);
+  auto line = std::string{};
   auto inside = size_t{};
-  for (auto y = 0; y <= input.ymax; ++y) {
-    auto last_turn = char{};
-    auto crossings = 0;
-    for (auto x = 0; x <= input.xmax; ++x) {
-      auto p = Point{x, y};
-      if (loop.contains(p)) {
-        auto next_turn = input.pieces.at(p);
-        if (next_turn == '-')
-          continue;
-        if (next_turn == '|')
-          ++crossings;
-        if (last_turn == 'F' && next_turn == 'J')
-          ++crossings;
-        if (last_turn == 'L' && next_turn == '7')
-          ++crossings;
-        last_turn = next_turn;
-      } else if (crossings % 2) {
-        ++inside;
-      }
+  for (auto y = 0; std::getline(input_handle, line); ++y) {
+    std::fill(crossing.begin(), crossing.end(), 0);
+    for (auto x = 0; x < int(line.size()); ++x) {
+      auto pipe = Point{x, y} == start ? start_pipe : pipes[uint8_t(line[x])];
+      crossing[size_t(x) / 64] |= uint64_t((pipe & North) != 0) << (x % 64);
+    }
+    const auto *loop = membership.row(y);
+    auto parity = uint64_t{};
+    for (auto w = size_t{}; w < membership.words; ++w) {
+      auto toggles = crossing[w] & loop[w];
+      auto odd = prefix_xor(toggles) ^ parity;
+      auto valid = ~uint64_t{};
+      if (auto tail = size_t(width) - w * 64; tail < 64)
+        valid = (uint64_t{1} << tail) - 1;
+      inside += size_t(std::popcount(odd & ~loop[w] & valid));
+      parity = odd >> 63 ? ~uint64_t{} : 0;
     }
-    if (crossings % 2)
+    if (parity)
       throw std::runtime_error{"uneven number of crossings"};
   }
   return inside;
 }
 
-auto draw_loop(const Maze &input) {
-  auto loop = std::unordered_set<Point>{};
-  loop.insert(input.start);
-  auto dir = pipes.at(input.pieces.at(input.start)).at(0);
-  auto next = input.start + dir;
-  while (true) {
-    loop.insert(next);
-    next = find_next(input, next, loop);
-    if (next == input.start)
-      return loop;
-  }
-}
-
 } // namespace
 
-auto main() -> int {
+auto main(int argc, char **argv) -> int {
   BOOST_LOG_TRIVIAL(debug) << "Starting up";
-  auto input = parse("input/10.txt");
+  auto filename = std::string{"input/10.txt"};
+  if (argc > 1 && std::string_view{argv[1]} == "--scanline") {
+    // Only the membership bitmap and a few cached rows are ever resident.
+    auto maze = scan(filename);
+    BOOST_LOG_TRIVIAL(debug) << "Input scanned";
+    auto membership = Bitmap{maze.xmax, maze.ymax};
+    auto loop = trace_loop(maze, &membership);
+    BOOST_LOG_TRIVIAL(info) << "Part 1: " << (loop.length / 2);
+    BOOST_LOG_TRIVIAL(info) << "Part 2: "
+                            << count_inside_streaming(filename, maze.start, maze.start_pipe,
+                                                      maze.xmax, membership);
+    return 0;
+  }
+  auto input = parse(filename);
   BOOST_LOG_TRIVIAL(debug) << "Input parsed";
-  auto loop = draw_loop(input);
-  BOOST_LOG_TRIVIAL(info) << "Part 1: " << (loop.size() / 2);         // 6882
-  BOOST_LOG_TRIVIAL(info) << "Part 2: " << count_inside(input, loop); // 491
+  auto loop = trace_loop(input);
+  BOOST_LOG_TRIVIAL(info) << "Part 1: " << (loop.length / 2); // 6882
+  BOOST_LOG_TRIVIAL(info) << "Part 2: " << loop.inside;       // 491
 }
@@ -1,8 +1,12 @@
 #include "point.h"
+#include "wide.h"
+#include <algorithm>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace {
@@ -31,49 +35,120 @@ auto parse(const std::string &filename) {
   return rval;
 }
 
-auto expand(const Galaxy &in, int expansion) {
-  auto square = std::max(in.height, in.width);
-  auto col_count = std::vector<int>(square);
-  auto row_count = std::vector<int>(square);
-  for (auto &galaxy : in.gals) {
-    col_count[galaxy.x]++;
-    row_count[galaxy.y]++;
+// Total pairwise distance as base + per_expansion * (expansion - 1).
+struct Distances {
+  size_t base;
+  size_t per_expansion;
+
+  auto at(size_t expansion) const {
+    return base + per_expansion * (expansion - 1);
+  }
+};
+
+// Every pair straddling the gap after position i contributes one unit for it,
+// plus expansion - 1 more if position i is empty.
+auto axis_distances(const std::vector<size_t> &counts, size_t total) {
+  auto rval = Distances{};
+  auto before = size_t{};
+  for (auto i = size_t{}; i < counts.size(); ++i) {
+    if (counts[i] == 0)
+      rval.per_expansion += before * (total - before);
+    before += counts[i];
+    if (i + 1 < counts.size())
+      rval.base += before * (total - before);
   }
-  auto col_inc = std::vector<int>(square);
-  auto row_inc = std::vector<int>(square);
-  auto col_exp = int{};
-  auto row_exp = int{};
-  for (auto i = int{}; i < square; ++i) {
-    if (col_count[i] == 0)
-      col_exp += expansion - 1;
-    col_inc[i] = col_exp;
-    if (row_count[i] == 0)
-      row_exp += expansion - 1;
-    row_inc[i] = row_exp;
+  return rval;
+}
+
+auto measure_distances(const Galaxy &galaxy) {
+  auto col_count = std::vector<size_t>(galaxy.width);
+  auto row_count = std::vector<size_t>(galaxy.height);
+  for (auto &g : galaxy.gals) {
+    col_count[g.x]++;
+    row_count[g.y]++;
   }
-  auto out = Galaxy{};
-  std::transform(in.gals.begin(), in.gals.end(), std::back_inserter(out.gals),
-                 [&](const Point &g) {
-                   return Point{g.x + col_inc[g.x], g.y + row_inc[g.y]};
-                 });
-  return out;
+  auto cols = axis_distances(col_count, galaxy.gals.size());
+  auto rows = axis_distances(row_count, galaxy.gals.size());
+  return Distances{cols.base + rows.base, cols.per_expansion + rows.per_expansion};
 }
 
-auto measure_distances(const Galaxy &unexpanded, int expansion = 2) {
-  auto expanded = expand(unexpanded, expansion);
-  auto rval = size_t{};
-  for (auto first = size_t{}; first < expanded.gals.size() - 1; ++first)
-    for (auto second = size_t{first} + 1; second < expanded.gals.size(); ++second)
-      rval += manhattan(expanded.gals.at(first), expanded.gals.at(second));
+using Coord = int64_t;
+using Wide = unsigned __int128;
+
+// Galaxies given as one "x y" pair per line, for universes too large and
+// sparse to hold as a map.
+struct SparseGalaxy {
+  std::vector<Coord> xs{};
+  std::vector<Coord> ys{};
+};
+
+auto parse_sparse(const std::string &filename) {
+  auto rval = SparseGalaxy{};
+  auto input_handle = std::ifstream{filename};
+  if (!input_handle)
+    throw std::runtime_error{"could not open file"};
+  auto x = Coord{};
+  auto y = Coord{};
+  while (input_handle >> x >> y) {
+    rval.xs.push_back(x);
+    rval.ys.push_back(y);
+  }
+  return rval;
+}
+
+struct SparseDistances {
+  Wide base;
+  Wide per_expansion;
+
+  auto at(Wide expansion) const {
+    return base + per_expansion * (expansion - 1);
+  }
+};
+
+// Same gap argument as axis_distances, but only over occupied coordinates:
+// the gap between neighbours holds (gap - 1) empty, expandable positions.
+auto sparse_axis_distances(std::vector<Coord> coords) {
+  std::sort(coords.begin(), coords.end());
+  auto total = Wide(coords.size());
+  auto rval = SparseDistances{};
+  auto before = Wide{};
+  for (auto i = size_t{}; i < coords.size();) {
+    auto j = i;
+    while (j < coords.size() && coords[j] == coords[i])
+      ++j;
+    before += j - i;
+    if (j < coords.size()) {
+      auto gap = Wide(coords[j] - coords[i]);
+      auto pairs = before * (total - before);
+      rval.base += pairs * gap;
+      rval.per_expansion += pairs * (gap - 1);
+    }
+    i = j;
+  }
   return rval;
 }
 
+auto measure_sparse(const SparseGalaxy &galaxy) {
+  auto cols = sparse_axis_distances(galaxy.xs);
+  auto rows = sparse_axis_distances(galaxy.ys);
+  return SparseDistances{cols.base + rows.base, cols.per_expansion + rows.per_expansion};
+}
+
 } // namespace
 
-auto main() -> int {
+auto main(int argc, char **argv) -> int {
   BOOST_LOG_TRIVIAL(debug) << "Starting up";
+  if (argc > 1 && std::string_view{argv[1]} == "--sparse") {
+    auto input = parse_sparse(argc > 2 ? argv[2] : "input/11.coords");
+    BOOST_LOG_TRIVIAL(debug) << "Input parsed";
+    auto distances = measure_sparse(input);
+    BOOST_LOG_TRIVIAL(info) << "Part 1: " << to_string(distances.at(2));
+    BOOST_LOG_TRIVIAL(info) << "Part 2: " << to_string(distances.at(1000000));
+    return 0;
+  }
   auto input = parse("input/11.txt");
   BOOST_LOG_TRIVIAL(debug) << "Input parsed";
-  BOOST_LOG_TRIVIAL(info) << "Part 1: " << measure_distances(input);          // 9522407
-  BOOST_LOG_TRIVIAL(info) << "Part 2: " << measure_distances(input, 1000000); // 544723432977
+  auto distances = measure_distances(input);
+  BOOST_LOG_TRIVIAL(info) << "Part 1: " << distances.at(2);       // 9522407
+  BOOST_LOG_TRIVIAL(info) << "Part 2: " << distances.at(1000000); // 544723432977
 }
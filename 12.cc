@@ -1,12 +1,16 @@
-#include "point.h"
+#include "parallel.h"
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
 #include <numeric>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace {
@@ -39,79 +43,142 @@ auto parse(const std::string &filename) {
   return rval;
 }
 
-constexpr auto could_be_dot(char c) {
-  return c == '.' || c == '?';
+// ways[i * (groups + 1) + g] counts the arrangements of groups g.. within
+// pattern[i..]. A prefix count of '.' makes each run check O(1): a run fits
+// where no cell in it is a dot.
+auto count_possibilities(const Spring &s) {
+  auto size = s.pattern.size();
+  auto groups = s.lengths.size();
+  auto stride = groups + 1;
+  thread_local auto dots = std::vector<size_t>{};
+  thread_local auto ways = std::vector<size_t>{};
+  dots.assign(size + 1, 0);
+  for (auto i = size_t{}; i < size; ++i)
+    dots[i + 1] = dots[i] + (s.pattern[i] == '.');
+  ways.assign((size + 2) * stride, 0);
+  ways[size * stride + groups] = 1;
+  ways[(size + 1) * stride + groups] = 1;
+  for (auto i = size; i-- > 0;) {
+    auto *row = &ways[i * stride];
+    const auto *skip = row + stride;
+    for (auto g = size_t{}; g <= groups; ++g) {
+      auto total = s.pattern[i] != '#' ? skip[g] : 0;
+      if (g < groups) {
+        auto end = i + size_t(s.lengths[g]);
+        if (end <= size && dots[end] == dots[i] && (end == size || s.pattern[end] != '#'))
+          total += ways[(end + 1) * stride + g + 1];
+      }
+      row[g] = total;
+    }
+  }
+  return ways[0];
 }
 
-constexpr auto could_be_hash(char c) {
-  return c == '#' || c == '?';
+using Mask = unsigned __int128;
+
+constexpr auto max_states = size_t{127};
+
+auto top_lane(Mask m) {
+  auto high = uint64_t(m >> 64);
+  return size_t(high ? 127 - std::countl_zero(high) : 63 - std::countl_zero(uint64_t(m)));
 }
 
-auto cache = std::unordered_map<Point, size_t>{};
-
-auto count_possibilities(const Spring &spring, const std::vector<int> &endpoints, int start,
-                         size_t depth) -> size_t {
-  auto point = Point{start, int(depth)};
-  if (auto find = cache.find(point); find != cache.end())
-    return find->second;
-  auto total = size_t{};
-  for (auto i = start; i <= endpoints.at(depth); ++i) {
-    auto trial = start;
-    while (trial < i) {
-      if (!could_be_dot(spring.pattern.at(trial)))
-        goto bad;
-      ++trial;
-    }
-    for (auto c = int{}; c < spring.lengths.at(depth); ++c) {
-      if (!could_be_hash(spring.pattern.at(trial)))
-        goto bad;
-      ++trial;
-    }
+auto low_lane(Mask m) {
+  auto low = uint64_t(m);
+  return size_t(low ? std::countr_zero(low) : 64 + std::countr_zero(uint64_t(m >> 64)));
+}
 
-    if (trial < int(spring.pattern.size())) {
-      if (!could_be_dot(spring.pattern.at(trial)))
-        goto bad;
-      ++trial;
+// Bit-parallel NFA for the pattern ".#{l1}.#{l2}...#{ln}.", where every '.'
+// state loops. Each cell advances the reachable state set with one shift and
+// two ANDs, (reached << 1) & enter | reached & loop, then masks out states too
+// far behind to finish: from state k every state up to the last group's must
+// still be passed, one cell each. The per-state counters are then updated
+// branch-free, with all-ones or zero lane masks per kind of cell, across the
+// window from the lowest live state to the highest ever reached. Work is per
+// cell times live states, so this wins when groups are short relative to the
+// slack. Patterns needing more than max_states states fall back to the DP.
+auto count_bitwise(const Spring &s) -> size_t {
+  auto states = size_t(std::accumulate(s.lengths.begin(), s.lengths.end(), 0)) +
+                s.lengths.size() + 1;
+  if (s.lengths.empty() || states > max_states)
+    return count_possibilities(s);
+  auto hash_states = Mask{};
+  auto dot_states = Mask{1};
+  auto k = size_t{};
+  for (auto length : s.lengths) {
+    for (auto i = 0; i < length; ++i)
+      hash_states |= Mask{1} << ++k;
+    dot_states |= Mask{1} << ++k;
+  }
+  auto kind = [](char c) {
+    return size_t(c == '.' ? 0 : c == '#' ? 1 : 2);
+  };
+  thread_local auto enter = std::array<Mask, 3>{};
+  thread_local auto loop = std::array<Mask, 3>{};
+  thread_local auto enter_lanes = std::array<std::array<size_t, max_states>, 3>{};
+  thread_local auto loop_lanes = std::array<std::array<size_t, max_states>, 3>{};
+  for (auto c : {'.', '#', '?'}) {
+    auto i = kind(c);
+    enter[i] = (c != '.' ? hash_states : 0) | (c != '#' ? dot_states : 0);
+    loop[i] = c != '#' ? dot_states : 0;
+    for (auto lane = size_t{}; lane < states; ++lane) {
+      enter_lanes[i][lane] = ((enter[i] >> lane) & 1) ? ~size_t{} : 0;
+      loop_lanes[i][lane] = ((loop[i] >> lane) & 1) ? ~size_t{} : 0;
     }
+  }
 
-    if (depth + 1 == endpoints.size()) {
-      while (trial < int(spring.pattern.size())) {
-        if (!could_be_dot(spring.pattern.at(trial)))
-          goto bad;
-        ++trial;
-      }
-      ++total;
-    } else {
-      total += count_possibilities(spring, endpoints, trial, depth + 1);
-    }
-  bad:
-    continue;
+  // counts[0] is a permanent zero below state 0.
+  thread_local auto counts = std::array<size_t, max_states + 1>{};
+  std::fill(counts.begin(), counts.begin() + long(states) + 1, 0);
+  auto *count = counts.data() + 1;
+  count[0] = 1;
+  auto reached = Mask{1};
+  auto low = size_t{};
+  auto high = size_t{};
+  auto size = s.pattern.size();
+  for (auto i = size_t{}; i < size && reached; ++i) {
+    auto c = kind(s.pattern[i]);
+    auto left = size - i - 1;
+    auto first_alive = states - 2 > left ? states - 2 - left : 0;
+    reached = (((reached << 1) & enter[c]) | (reached & loop[c])) & (~Mask{} << first_alive);
+    if (!reached)
+      break;
+    high = std::max(high, top_lane(reached));
+    const auto *in = enter_lanes[c].data();
+    const auto *stay = loop_lanes[c].data();
+    for (auto lane = high + 1; lane-- > low;)
+      count[lane] = (in[lane] & count[lane - 1]) + (stay[lane] & count[lane]);
+    for (auto next_low = low_lane(reached); low < next_low; ++low)
+      count[low] = 0;
   }
-  cache.insert({point, total});
-  return total;
+  return reached ? count[states - 1] + count[states - 2] : 0;
 }
 
-auto count_possibilities(const Spring &s) {
-  auto end = std::vector<int>(s.lengths.size());
-  auto count = int(s.pattern.size());
-  for (auto i = int(s.lengths.size()) - 1; i >= 0; --i) {
-    count -= s.lengths.at(i);
-    end.at(i) = count;
-    --count;
-  }
-  cache.clear();
-  return count_possibilities(s, end, 0, 0);
+template <typename F>
+auto parallel_sum(const Springs &input, F count) {
+  return parallel_fold(input.size(), size_t{}, [&](size_t begin, size_t end) {
+    auto rval = size_t{};
+    for (auto i = begin; i < end; ++i)
+      rval += count(input[i]);
+    return rval;
+  });
 }
 
-auto part1(const Springs &input) {
-  return std::accumulate(input.cbegin(), input.cend(), size_t{}, [](auto a, const auto &b) {
-    return a + count_possibilities(b);
+enum class Engine { Dp, Bits, Transfer };
+
+auto count_with(const Spring &s, Engine engine) {
+  return engine == Engine::Bits ? count_bitwise(s) : count_possibilities(s);
+}
+
+auto part1(const Springs &input, Engine engine) {
+  return parallel_sum(input, [engine](const Spring &s) {
+    return count_with(s, engine);
   });
 }
 
-auto unfold(const Spring &s) {
+auto unfold(const Spring &s, size_t copies) {
   auto rval = Spring{};
-  for (auto i = 0; i < 5; ++i) {
+  for (auto i = size_t{}; i < copies; ++i) {
     if (!rval.pattern.empty())
       rval.pattern.push_back('?');
     rval.pattern.append(s.pattern);
@@ -120,18 +187,202 @@ auto unfold(const Spring &s) {
   return rval;
 }
 
-auto part2(const Springs &input) {
-  return std::accumulate(input.cbegin(), input.cend(), size_t{}, [](auto a, const auto &b) {
-    return a + count_possibilities(unfold(b));
+// Automaton state between cells: group is the index of the next group to
+// finish, run how many of its cells are placed. run == length means the group
+// is complete and the next cell must be a dot.
+struct Exit {
+  size_t advance;
+  int run;
+  size_t count;
+};
+
+// For every state a copy can be entered in (relative to the group list
+// period), the states it can leave in after reading segment and how many
+// ways. Each entry state is worked out the first time a pass reaches it.
+struct Transitions {
+  const Spring &spring;
+  std::string segment;
+  // Runs are at most width - 1 long, and a copy advances at most reach groups.
+  size_t width;
+  size_t reach;
+  std::vector<std::vector<Exit>> exits{};
+  std::vector<bool> known{};
+  std::vector<size_t> states{};
+  std::vector<size_t> next{};
+
+  auto explore(size_t first, size_t entry) {
+    auto groups = spring.lengths.size();
+    auto advances = reach + 1;
+    auto top = size_t{};
+    std::fill(states.begin(), states.begin() + long(width), 0);
+    states[entry] = 1;
+    for (auto c : segment) {
+      std::fill(next.begin(), next.begin() + long(std::min(top + 2, advances) * width), 0);
+      auto next_top = top;
+      for (auto advance = size_t{}; advance <= top; ++advance) {
+        auto length = size_t(spring.lengths[(first + advance) % groups]);
+        const auto *row = &states[advance * width];
+        auto *out = &next[advance * width];
+        if (c != '#')
+          out[0] += row[0];
+        if (c != '.')
+          for (auto run = length; run-- > 0;)
+            out[run + 1] += row[run];
+        if (c != '#' && row[length] && advance + 1 < advances) {
+          out[width] += row[length];
+          next_top = std::max(next_top, advance + 1);
+        }
+      }
+      std::swap(states, next);
+      top = next_top;
+    }
+    auto rval = std::vector<Exit>{};
+    for (auto advance = size_t{}; advance <= top; ++advance)
+      for (auto run = size_t{}; run < width; ++run)
+        if (auto count = states[advance * width + run])
+          rval.push_back({advance, int(run), count});
+    return rval;
+  }
+
+  Transitions(const Spring &s, std::string text)
+      : spring{s}, segment{std::move(text)},
+        width{size_t(*std::max_element(s.lengths.begin(), s.lengths.end())) + 1},
+        reach{segment.size() / 2 + 1} {
+    exits.resize(s.lengths.size() * width);
+    known.resize(exits.size());
+    states.resize((reach + 1) * width);
+    next.resize(states.size());
+  }
+
+  auto from(size_t first, int run) -> const std::vector<Exit> & {
+    auto index = first * width + size_t(run);
+    if (!known[index]) {
+      exits[index] = explore(first, size_t(run));
+      known[index] = true;
+    }
+    return exits[index];
+  }
+};
+
+// Count the arrangements of copies joined by '?' without building the unfolded
+// pattern: one pass over the copies applies the precomputed transitions, with
+// counts modulo 2^64. Every copy is read with its joiner, and counting only
+// the states with every group closed treats the last joiner as a dot. Live
+// states sit in a flat array over a window of groups, bounded above by
+// reachability and below by dropping states that can no longer fit their
+// remaining groups into the remaining cells. Rows anchored by '#' keep the
+// window small; on rows of mostly '?' it grows with the copies.
+auto count_unfolded(const Spring &s, size_t copies) {
+  auto groups = s.lengths.size();
+  auto total = copies * groups;
+  auto transitions = Transitions{s, s.pattern + '?'};
+  auto width = transitions.width;
+  auto period = size_t(std::accumulate(s.lengths.begin(), s.lengths.end(), 0));
+  auto prefix = std::vector<size_t>{0};
+  for (auto length : s.lengths)
+    prefix.push_back(prefix.back() + size_t(length));
+  auto cells_needed = [&](size_t group, int run) {
+    auto remaining = total - group;
+    if (remaining == 0)
+      return size_t{};
+    auto start = group % groups;
+    auto full = remaining / groups;
+    auto part = remaining % groups;
+    auto tail = start + part <= groups
+                    ? prefix[start + part] - prefix[start]
+                    : prefix[groups] - prefix[start] + prefix[start + part - groups];
+    return full * period + tail + remaining - 1 - size_t(run);
+  };
+  // Ways through a copy once every group is placed: 1 if it can be all dots.
+  auto blank = size_t{};
+  for (auto exit : transitions.from(0, 0))
+    if (exit.advance == 0 && exit.run == 0)
+      blank = exit.count;
+
+  // states[(group - low) * width + run]
+  auto low = size_t{};
+  auto states = std::vector<size_t>(width);
+  auto next = std::vector<size_t>{};
+  states[0] = 1;
+  for (auto copy = size_t{}; copy < copies; ++copy) {
+    auto cells_left = (copies - copy - 1) * (s.pattern.size() + 1);
+    auto span = states.size() / width;
+    // Groups from safe on always fit; only those below it need the check.
+    auto safe = low;
+    for (auto high = total; safe < high;) {
+      auto mid = (safe + high) / 2;
+      if (cells_needed(mid, 0) <= cells_left)
+        high = mid;
+      else
+        safe = mid + 1;
+    }
+    auto next_span = std::min(low + span + transitions.reach, total + 1) - low;
+    next.assign(next_span * width, 0);
+    for (auto i = size_t{}; i < span; ++i) {
+      auto group = low + i;
+      for (auto run = 0; run < int(width); ++run) {
+        auto count = states[i * width + size_t(run)];
+        if (!count)
+          continue;
+        if (group == total) {
+          next[i * width] += count * blank;
+          continue;
+        }
+        for (auto exit : transitions.from(group % groups, run)) {
+          auto reached = group + exit.advance;
+          if (reached > total || (reached == total && exit.run != 0))
+            continue;
+          if (reached < safe && cells_needed(reached, exit.run) > cells_left)
+            continue;
+          next[(reached - low) * width + size_t(exit.run)] += count * exit.count;
+        }
+      }
+    }
+    auto live = [&](size_t row) {
+      return std::any_of(next.begin() + long(row * width), next.begin() + long((row + 1) * width),
+                         [](size_t count) {
+                           return count != 0;
+                         });
+    };
+    auto first = size_t{};
+    while (first < next_span && !live(first))
+      ++first;
+    if (first == next_span)
+      return size_t{};
+    auto end = next_span;
+    while (!live(end - 1))
+      --end;
+    states.assign(next.begin() + long(first * width), next.begin() + long(end * width));
+    low += first;
+  }
+  return low + states.size() / width == total + 1 ? states[(total - low) * width] : 0;
+}
+
+auto part2(const Springs &input, Engine engine, size_t copies) {
+  return parallel_sum(input, [engine, copies](const Spring &s) {
+    if (engine == Engine::Transfer)
+      return count_unfolded(s, copies);
+    return count_with(unfold(s, copies), engine);
   });
 }
 
 } // namespace
 
-auto main() -> int {
+auto main(int argc, char **argv) -> int {
   BOOST_LOG_TRIVIAL(debug) << "Starting up";
+  auto engine = Engine::Dp;
+  auto copies = size_t{5};
+  for (auto i = 1; i < argc; ++i) {
+    auto arg = std::string_view{argv[i]};
+    if (arg == "--bits")
+      engine = Engine::Bits;
+    else if (arg == "--transfer")
+      engine = Engine::Transfer;
+    else if (arg == "--unfold" && i + 1 < argc)
+      copies = std::stoul(argv[++i]);
+  }
   auto input = parse("input/12.txt");
   BOOST_LOG_TRIVIAL(debug) << "Input parsed";
-  BOOST_LOG_TRIVIAL(info) << "Part 1: " << part1(input); // 7792
-  BOOST_LOG_TRIVIAL(info) << "Part 2: " << part2(input); // 13012052341533
+  BOOST_LOG_TRIVIAL(info) << "Part 1: " << part1(input, engine);         // 7792
+  BOOST_LOG_TRIVIAL(info) << "Part 2: " << part2(input, engine, copies); // 13012052341533
 }
@@ -1,4 +1,6 @@
+#include <bit>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
 #include <stdexcept>
 #include <string>
@@ -6,84 +8,84 @@
 
 namespace {
 
-using Mirror = std::vector<std::string>;
+// Each row and column as a bitmask, '#' set. mismatches[i] is the number of
+// differing cells when reflecting about the line after row (or column) i.
+struct Axis {
+  std::vector<uint64_t> lines{};
+  std::vector<int> mismatches{};
+};
+
+struct Mirror {
+  Axis rows{};
+  Axis cols{};
+};
+
 using Parse = std::vector<Mirror>;
 
+auto find_mismatches(Axis &axis) {
+  auto size = int(axis.lines.size());
+  for (auto i = 0; i < size - 1; ++i) {
+    auto smudge = 0;
+    for (auto a = i, b = i + 1; a >= 0 && b < size; --a, ++b)
+      smudge += std::popcount(axis.lines[a] ^ axis.lines[b]);
+    axis.mismatches.push_back(smudge);
+  }
+}
+
+auto encode(const std::vector<std::string> &lines) {
+  auto rval = Mirror{};
+  auto width = lines.at(0).size();
+  if (width > 64 || lines.size() > 64)
+    throw std::runtime_error{"mirror too large"};
+  rval.cols.lines.resize(width);
+  for (auto y = size_t{}; y < lines.size(); ++y) {
+    auto row = uint64_t{};
+    for (auto x = size_t{}; x < width; ++x)
+      if (lines[y].at(x) == '#') {
+        row |= uint64_t{1} << x;
+        rval.cols.lines[x] |= uint64_t{1} << y;
+      }
+    rval.rows.lines.push_back(row);
+  }
+  find_mismatches(rval.rows);
+  find_mismatches(rval.cols);
+  return rval;
+}
+
 auto parse(const std::string &filename) {
   auto rval = Parse{};
   auto input_handle = std::ifstream{filename};
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
   auto line = std::string{};
+  auto lines = std::vector<std::string>{};
   while (input_handle) {
-    rval.emplace_back();
+    lines.clear();
     while (std::getline(input_handle, line)) {
       if (line.empty())
         break;
-      rval.back().push_back(line);
+      lines.push_back(line);
     }
+    if (!lines.empty())
+      rval.push_back(encode(lines));
   }
   return rval;
 }
 
-template <int smudges>
-auto hori_reflect(const Mirror &mirror) {
-  auto width = int(mirror.at(0).size());
-  auto height = int(mirror.size());
-  for (auto i = 0; i < width - 1; ++i) {
-    auto smudge = 0;
-    for (auto y = 0; y < height; ++y) {
-      for (auto x = i; x < width; ++x) {
-        auto offs = x - i;
-        if (i - offs < 0 || 1 + i + offs >= width)
-          continue;
-        if (mirror.at(y).at(1 + i + offs) != mirror.at(y).at(i - offs))
-          ++smudge;
-        if (smudge > smudges)
-          goto next;
-      }
-    }
-    if (smudge == smudges)
+auto reflect(const Axis &axis, int smudges) {
+  for (auto i = 0; i < int(axis.mismatches.size()); ++i)
+    if (axis.mismatches[i] == smudges)
       return i + 1;
-  next:
-    continue;
-  }
-  return 0;
-}
-
-template <int smudges>
-auto vert_reflect(const Mirror &mirror) {
-  auto width = int(mirror.at(0).size());
-  auto height = int(mirror.size());
-  for (auto i = 0; i < height; ++i) {
-    auto smudge = 0;
-    for (auto x = 0; x < width; ++x) {
-      for (auto y = i; y < height; ++y) {
-        auto offs = y - i;
-        if (i - offs < 0 || 1 + i + offs >= height)
-          continue;
-        if (mirror.at(1 + i + offs).at(x) != mirror.at(i - offs).at(x))
-          ++smudge;
-        if (smudge > smudges)
-          goto next;
-      }
-    }
-    if (smudge == smudges)
-      return 100 * (i + 1);
-  next:
-    continue;
-  }
   return 0;
 }
 
-template <int smudges>
-auto count_reflections(const Parse &input) {
+auto count_reflections(const Parse &input, int smudges) {
   auto rval = size_t{};
   for (auto &mirror : input) {
-    if (auto h = hori_reflect<smudges>(mirror))
+    if (auto h = reflect(mirror.cols, smudges))
       rval += h;
-    else if (auto v = vert_reflect<smudges>(mirror))
-      rval += v;
+    else if (auto v = reflect(mirror.rows, smudges))
+      rval += 100 * v;
     else
       throw std::runtime_error{"vampire"};
   }
@@ -96,6 +98,6 @@ auto main() -> int {
   BOOST_LOG_TRIVIAL(debug) << "Starting up";
   auto input = parse("input/13.txt");
   BOOST_LOG_TRIVIAL(debug) << "Input parsed";
-  BOOST_LOG_TRIVIAL(info) << "Part 1: " << count_reflections<0>(input); // 30535
-  BOOST_LOG_TRIVIAL(info) << "Part 2: " << count_reflections<1>(input); // 30844
+  BOOST_LOG_TRIVIAL(info) << "Part 1: " << count_reflections(input, 0); // 30535
+  BOOST_LOG_TRIVIAL(info) << "Part 2: " << count_reflections(input, 1); // 30844
 }
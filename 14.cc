@@ -1,119 +1,232 @@
 #include <algorithm>
+#include <bit>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
-#include <iterator>
-#include <numeric>
-#include <set>
-#include <sstream>
+#include <optional>
 #include <stdexcept>
 #include <string>
-#include <unordered_set>
+#include <unordered_map>
 #include <vector>
 
-#include "point.h"
-
 namespace {
 
+// A grid of bits stored a line at a time, each line padded to whole words.
+struct Bits {
+  size_t words{};
+  std::vector<uint64_t> data{};
+
+  Bits() = default;
+  Bits(size_t lines, size_t length) : words{(length + 63) / 64}, data(lines * words) {}
+
+  auto line(size_t l) {
+    return data.data() + l * words;
+  }
+  auto line(size_t l) const {
+    return data.data() + l * words;
+  }
+  auto set(size_t l, size_t i) {
+    line(l)[i / 64] |= uint64_t{1} << (i % 64);
+  }
+  auto count(size_t l, size_t begin, size_t end) const {
+    const auto *row = line(l);
+    auto rval = 0;
+    while (begin < end) {
+      auto bits = std::min(end - begin, 64 - begin % 64);
+      auto mask = bits == 64 ? ~uint64_t{} : ((uint64_t{1} << bits) - 1) << (begin % 64);
+      rval += std::popcount(row[begin / 64] & mask);
+      begin += bits;
+    }
+    return rval;
+  }
+  auto fill(size_t l, size_t begin, size_t end) {
+    auto *row = line(l);
+    while (begin < end) {
+      auto bits = std::min(end - begin, 64 - begin % 64);
+      auto mask = bits == 64 ? ~uint64_t{} : ((uint64_t{1} << bits) - 1) << (begin % 64);
+      row[begin / 64] |= mask;
+      begin += bits;
+    }
+  }
+  auto clear() {
+    std::fill(data.begin(), data.end(), 0);
+  }
+};
+
+// Runs of cells between cube rocks, per line.
+struct Segment {
+  size_t begin;
+  size_t end;
+};
+
+using Segments = std::vector<std::vector<Segment>>;
+
+// Round rocks are kept both row-wise and column-wise so that every tilt runs
+// along a line; spare buffers are swapped in rather than reallocated.
 struct Dish {
-  std::unordered_set<Point> round{};
-  std::unordered_set<Point> square{};
-  int width;
-  int height;
+  size_t width{};
+  size_t height{};
+  Segments row_segments{};
+  Segments col_segments{};
+  Bits rows{};
+  Bits cols{};
+  Bits next_rows{};
+  Bits next_cols{};
 };
 
 using Parse = Dish;
 
+auto find_segments(const std::vector<std::string> &grid, size_t lines, size_t length,
+                   bool by_column) {
+  auto rval = Segments(lines);
+  for (auto l = size_t{}; l < lines; ++l) {
+    auto begin = size_t{};
+    for (auto i = size_t{}; i <= length; ++i) {
+      auto cube = i == length || (by_column ? grid[i][l] : grid[l][i]) == '#';
+      if (!cube)
+        continue;
+      if (begin < i)
+        rval[l].push_back({begin, i});
+      begin = i + 1;
+    }
+  }
+  return rval;
+}
+
 auto parse(const std::string &filename) {
   auto rval = Parse{};
   auto input_handle = std::ifstream{filename};
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
+  auto grid = std::vector<std::string>{};
   auto line = std::string{};
-  auto y = 0;
   while (std::getline(input_handle, line)) {
-    rval.width = std::max(rval.width, int(line.size()));
-    for (auto x = 0; x < int(line.size()); ++x) {
-      if (line.at(x) == 'O')
-        rval.round.insert({x, y});
-      else if (line.at(x) == '#')
-        rval.square.insert({x, y});
-    }
-    ++y;
+    rval.width = std::max(rval.width, line.size());
+    grid.push_back(line);
   }
-  rval.height = y;
+  rval.height = grid.size();
+  for (auto &row : grid)
+    row.resize(rval.width, '.');
+  rval.rows = rval.next_rows = Bits{rval.height, rval.width};
+  rval.cols = rval.next_cols = Bits{rval.width, rval.height};
+  for (auto y = size_t{}; y < rval.height; ++y)
+    for (auto x = size_t{}; x < rval.width; ++x)
+      if (grid[y][x] == 'O') {
+        rval.rows.set(y, x);
+        rval.cols.set(x, y);
+      }
+  rval.row_segments = find_segments(grid, rval.height, rval.width, false);
+  rval.col_segments = find_segments(grid, rval.width, rval.height, true);
   return rval;
 }
 
-auto roll(Dish d, const Point &dir) {
-  auto rollers = std::vector<Point>{d.round.begin(), d.round.end()};
-  if (dir == Point{0, -1} || dir == Point{-1, 0}) {
-    std::sort(rollers.begin(), rollers.end(), [&](const Point &a, const Point &b) {
-      return a.y == b.y ? a.x < b.x : a.y < b.y;
-    });
-  } else {
-    std::sort(rollers.begin(), rollers.end(), [&](const Point &a, const Point &b) {
-      return a.y == b.y ? a.x > b.x : a.y > b.y;
-    });
-  }
-  auto next_round = decltype(d.round){};
-  for (auto &roller : rollers) {
-    auto r = roller;
-    while (true) {
-      auto prospective = r + dir;
-      if (prospective.y < 0 || prospective.x < 0 || prospective.x >= d.width ||
-          prospective.y >= d.height) {
-        next_round.insert(r);
-        break;
-      }
-      if (next_round.contains(prospective) || d.square.contains(prospective)) {
-        next_round.insert(r);
-        break;
-      }
-      r = prospective;
+enum class Tilt { North, West, South, East };
+
+// Gather each segment's round rocks at one end: a popcount and a run fill on
+// the lines being tilted, mirrored bit by bit into the other orientation.
+auto roll(Dish &d, Tilt tilt) {
+  auto vertical = tilt == Tilt::North || tilt == Tilt::South;
+  auto towards_start = tilt == Tilt::North || tilt == Tilt::West;
+  auto &segments = vertical ? d.col_segments : d.row_segments;
+  auto &from = vertical ? d.cols : d.rows;
+  auto &along = vertical ? d.next_cols : d.next_rows;
+  auto &across = vertical ? d.next_rows : d.next_cols;
+  along.clear();
+  across.clear();
+  for (auto l = size_t{}; l < segments.size(); ++l)
+    for (auto [begin, end] : segments[l]) {
+      auto rocks = size_t(from.count(l, begin, end));
+      if (!rocks)
+        continue;
+      auto first = towards_start ? begin : end - rocks;
+      along.fill(l, first, first + rocks);
+      for (auto i = first; i < first + rocks; ++i)
+        across.set(i, l);
     }
-  }
-  std::swap(d.round, next_round);
-  return d;
+  std::swap(d.rows, d.next_rows);
+  std::swap(d.cols, d.next_cols);
 }
 
 auto load(const Dish &d) {
-  return std::accumulate(d.round.begin(), d.round.end(), 0L, [&d](size_t a, const Point &p) {
-    return a + d.height - p.y;
-  });
+  auto rval = size_t{};
+  for (auto y = size_t{}; y < d.height; ++y)
+    rval += size_t(d.rows.count(y, 0, d.width)) * (d.height - y);
+  return rval;
 }
 
-auto dodgy_hash(const Dish &d) {
-  return std::accumulate(d.round.begin(), d.round.end(), 13L, [](size_t a, const Point &p) {
-    return 7 * a + std::hash<Point>()(p);
-  });
+struct Hash128 {
+  uint64_t low;
+  uint64_t high;
+
+  auto operator==(const Hash128 &) const -> bool = default;
+};
+
+struct Hash128Hasher {
+  auto operator()(const Hash128 &h) const noexcept {
+    return size_t(h.low);
+  }
+};
+
+constexpr auto mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+auto hash128(const std::vector<uint64_t> &words) {
+  auto rval = Hash128{0x9e3779b97f4a7c15, 0xc2b2ae3d27d4eb4f};
+  for (auto w : words) {
+    rval.low = mix(rval.low ^ w) + 0x165667b19e3779f9;
+    rval.high = std::rotl(rval.high + mix(w ^ 0x27d4eb2f165667c5), 29) * 0x85ebca77c2b2ae63;
+  }
+  return rval;
 }
 
-auto part1(const Parse &input) {
-  return load(roll(input, {0, -1}));
+// Records states in order and reports the first earlier index holding an
+// identical state. States are keyed by a 128-bit hash and compared exactly on
+// a hash match, so a collision can never fake a cycle.
+struct CycleDetector {
+  std::unordered_multimap<Hash128, size_t, Hash128Hasher> seen{};
+  std::vector<std::vector<uint64_t>> states{};
+
+  auto insert(const std::vector<uint64_t> &state) -> std::optional<size_t> {
+    auto hash = hash128(state);
+    auto [begin, end] = seen.equal_range(hash);
+    for (auto it = begin; it != end; ++it)
+      if (states[it->second] == state)
+        return it->second;
+    seen.insert({hash, states.size()});
+    states.push_back(state);
+    return std::nullopt;
+  }
+};
+
+auto part1(Parse input) {
+  roll(input, Tilt::North);
+  return load(input);
 }
 
-constexpr auto LIMIT = 1000000000;
+constexpr auto LIMIT = size_t{1000000000};
 
 auto part2(Dish dish) {
-  auto loop = std::vector<size_t>{};
-  auto cycle = 0;
-  while (true) {
-    dish = roll(dish, {0, -1});
-    dish = roll(dish, {-1, 0});
-    dish = roll(dish, {0, 1});
-    dish = roll(dish, {1, 0});
-    auto nextup = dodgy_hash(dish);
-    if (auto find = std::find(loop.begin(), loop.end(), nextup); find != loop.end()) {
-      auto skip = 4 * std::distance(find, loop.end());
-      while (cycle + skip < LIMIT)
-        cycle += skip;
-      loop.clear();
+  auto detector = CycleDetector{};
+  auto loads = std::vector<size_t>{};
+  for (auto cycle = size_t{}; cycle <= LIMIT; ++cycle) {
+    if (auto first = detector.insert(dish.rows.data)) {
+      auto period = cycle - *first;
+      return loads[*first + (LIMIT - *first) % period];
     }
-    cycle += 4;
-    loop.push_back(nextup);
-    if (cycle > LIMIT)
-      return load(dish);
+    loads.push_back(load(dish));
+    if (cycle == LIMIT)
+      break;
+    roll(dish, Tilt::North);
+    roll(dish, Tilt::West);
+    roll(dish, Tilt::South);
+    roll(dish, Tilt::East);
   }
+  return loads.back();
 }
 
 } // namespace
@@ -1,87 +1,177 @@
+#include "parallel.h"
+#include <algorithm>
 #include <boost/log/trivial.hpp>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
-#include <numeric>
-#include <sstream>
+#include <iterator>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace {
 
-using Parse = std::vector<std::string>;
+using Parse = std::string;
 
 auto parse(const std::string &filename) {
-  auto rval = Parse{};
-  auto input_handle = std::ifstream{filename};
+  auto input_handle = std::ifstream{filename, std::ios::binary};
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
-  auto line = std::string{};
-  std::getline(input_handle, line);
-  auto ss = std::stringstream{line};
-  auto s = std::string{};
-  while (ss) {
-    std::getline(ss, s, ',');
-    rval.push_back(s);
-  }
+  auto rval = Parse{std::istreambuf_iterator<char>{input_handle}, {}};
+  while (!rval.empty() && (rval.back() == '\n' || rval.back() == '\r'))
+    rval.pop_back();
   return rval;
 }
 
-auto hash(const std::string &word) {
-  auto rval = int{};
+// Calls f on each comma-separated step without copying; memchr does the
+// comma search a vector at a time.
+template <typename F>
+auto for_each_step(std::string_view sequence, F f) {
+  while (true) {
+    const auto *comma =
+        static_cast<const char *>(std::memchr(sequence.data(), ',', sequence.size()));
+    if (!comma) {
+      f(sequence);
+      return;
+    }
+    auto length = size_t(comma - sequence.data());
+    f(sequence.substr(0, length));
+    sequence.remove_prefix(length + 1);
+  }
+}
+
+// Arithmetic in uint8_t makes the modulo 256 free and 17x is (x << 4) + x.
+auto hash(std::string_view word) {
+  auto rval = uint8_t{};
   for (auto c : word) {
-    rval += c;
-    rval *= 17;
-    rval %= 256;
+    rval = uint8_t(rval + uint8_t(c));
+    rval = uint8_t((rval << 4) + rval);
   }
+  return int{rval};
+}
+
+auto hash_sum(std::string_view sequence) {
+  auto rval = size_t{};
+  for_each_step(sequence, [&rval](std::string_view step) {
+    rval += size_t(hash(step));
+  });
   return rval;
 }
 
+// Hash the sequence in one chunk per hardware thread. Each chunk takes the
+// steps that start inside its byte range, so no step is split or counted twice.
 auto part1(const Parse &input) {
-  return std::accumulate(input.begin(), input.end(), 0L, [](auto count, auto &word) {
-    return count + hash(word);
+  auto sequence = std::string_view{input};
+  auto step_start = [sequence](size_t at) {
+    if (at == 0 || at >= sequence.size())
+      return std::min(at, sequence.size());
+    auto comma = sequence.find(',', at - 1);
+    return comma == sequence.npos ? sequence.size() : comma + 1;
+  };
+  return parallel_fold(sequence.size(), size_t{}, [&](size_t begin, size_t end) {
+    auto from = step_start(begin);
+    auto to = step_start(end);
+    if (from >= to)
+      return size_t{};
+    return hash_sum(sequence.substr(from, to - from - (to < sequence.size() ? 1 : 0)));
   });
 }
 
-struct Lens {
-  std::string code;
+constexpr auto none = -1;
+
+// Lenses live in a slot pool; each box is a doubly linked list through the
+// pool, and slot_for maps an interned label straight to its slot, so replacing
+// or removing a lens never searches its box.
+struct Slot {
+  int label;
   int power;
+  int prev;
+  int next;
 };
 
-using Boxes = std::vector<std::vector<Lens>>;
+struct Box {
+  int head = none;
+  int tail = none;
+};
 
-auto dash(Boxes &boxes, const std::string &lens) {
-  auto box = hash(lens);
-  for (auto slot = size_t{}; slot < boxes.at(box).size(); ++slot)
-    if (boxes.at(box).at(slot).code == lens) {
-      boxes.at(box).erase(boxes.at(box).begin() + slot);
-      return;
+struct Boxes {
+  std::vector<Box> boxes = std::vector<Box>(256);
+  std::vector<Slot> slots{};
+  std::vector<int> free{};
+  std::vector<int> slot_for{};
+  std::vector<int> box_for{};
+  std::unordered_map<std::string_view, int> labels{};
+
+  auto intern(std::string_view label) {
+    auto [it, inserted] = labels.try_emplace(label, int(labels.size()));
+    if (inserted) {
+      slot_for.push_back(none);
+      box_for.push_back(hash(label));
     }
-}
+    return it->second;
+  }
 
-auto equals(Boxes &boxes, const Lens &lens) {
-  auto box = hash(lens.code);
-  for (auto slot = size_t{}; slot < boxes.at(box).size(); ++slot)
-    if (boxes.at(box).at(slot).code == lens.code) {
-      boxes.at(box).at(slot).power = lens.power;
+  auto dash(int label) {
+    auto slot = slot_for[label];
+    if (slot == none)
+      return;
+    auto &box = boxes[box_for[label]];
+    auto prev = slots[slot].prev;
+    auto next = slots[slot].next;
+    (prev == none ? box.head : slots[prev].next) = next;
+    (next == none ? box.tail : slots[next].prev) = prev;
+    slot_for[label] = none;
+    free.push_back(slot);
+  }
+
+  auto equals(int label, int power) {
+    if (auto slot = slot_for[label]; slot != none) {
+      slots[slot].power = power;
       return;
     }
-  boxes.at(box).push_back(lens);
-}
+    auto &box = boxes[box_for[label]];
+    auto slot = int(slots.size());
+    if (free.empty()) {
+      slots.push_back({});
+    } else {
+      slot = free.back();
+      free.pop_back();
+    }
+    slots[slot] = {label, power, box.tail, none};
+    (box.tail == none ? box.head : slots[box.tail].next) = slot;
+    box.tail = slot;
+    slot_for[label] = slot;
+  }
+};
 
 auto part2(const Parse &input) {
-  auto boxes = Boxes(256);
-  for (auto &lens_code : input) {
-    if (lens_code.at(lens_code.size() - 1) == '-') {
-      dash(boxes, lens_code.substr(0, lens_code.size() - 1));
+  auto boxes = Boxes{};
+  for_each_step(input, [&boxes](std::string_view lens_code) {
+    if (lens_code.empty())
+      throw std::runtime_error{"empty step"};
+    if (lens_code.back() == '-') {
+      boxes.dash(boxes.intern(lens_code.substr(0, lens_code.size() - 1)));
     } else {
       auto eq = lens_code.find('=');
-      equals(boxes, {lens_code.substr(0, eq), std::stoi(lens_code.substr(eq + 1))});
+      if (eq == lens_code.npos)
+        throw std::runtime_error{"bad step"};
+      auto power = 0;
+      auto end = lens_code.data() + lens_code.size();
+      auto [ptr, ec] = std::from_chars(lens_code.data() + eq + 1, end, power);
+      if (ec != std::errc{} || ptr != end)
+        throw std::runtime_error{"bad focal length"};
+      boxes.equals(boxes.intern(lens_code.substr(0, eq)), power);
     }
-  }
+  });
   auto rval = 0L;
-  for (auto box = size_t{}; box < boxes.size(); ++box)
-    for (auto slot = size_t{}; slot < boxes.at(box).size(); ++slot)
-      rval += (box + 1) * (slot + 1) * boxes.at(box).at(slot).power;
+  for (auto box = size_t{}; box < boxes.boxes.size(); ++box) {
+    auto position = size_t{1};
+    for (auto slot = boxes.boxes[box].head; slot != none; slot = boxes.slots[slot].next)
+      rval += (box + 1) * position++ * boxes.slots[slot].power;
+  }
   return rval;
 }
 
@@ -91,6 +181,6 @@ auto main() -> int {
   BOOST_LOG_TRIVIAL(debug) << "Starting up";
   auto input = parse("input/15.txt");
   BOOST_LOG_TRIVIAL(debug) << "Input parsed";
-  BOOST_LOG_TRIVIAL(info) << "Part 1: " << part1(input); // 495972
+  BOOST_LOG_TRIVIAL(info) << "Part 1: " << part1(input);
   BOOST_LOG_TRIVIAL(info) << "Part 2: " << part2(input); // 245223
 }
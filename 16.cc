@@ -1,14 +1,17 @@
 #include "parsing.h"
 #include "point.h"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
 #include <future>
 #include <numeric>
-#include <sstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace {
@@ -29,123 +32,179 @@ struct Beam {
   Point dir;
 };
 
-auto energise(const Parse &input, const Beam &origin) {
-  auto beams = std::vector<Beam>{};
-  auto width = int(input.at(0).size());
-  auto height = int(input.size());
-  beams.push_back(origin);
-  auto contraption = std::unordered_map<Point, int>{};
-  while (!beams.empty()) {
-    auto beam = beams.back();
-    beams.pop_back();
-
-    if (beam.dir == P::left && beam.pos.x < width) {
-      if (contraption.contains(beam.pos) && contraption.at(beam.pos) & Dir::LEFT)
-        continue;
-      contraption[beam.pos] |= Dir::LEFT;
+constexpr auto edge = -1;
+
+auto dir_index(const Point &dir) {
+  return dir == P::up ? 0 : dir == P::down ? 1 : dir == P::left ? 2 : 3;
+}
+
+constexpr auto dir_bit = std::array{Dir::UP, Dir::DOWN, Dir::LEFT, Dir::RIGHT};
+
+// The grid flattened, with next[cell * 4 + d] holding the nearest optical
+// element strictly beyond cell in direction d, or edge.
+struct Contraption {
+  int width;
+  int height;
+  std::string cells{};
+  std::vector<int> next{};
+};
+
+auto build(const Parse &input) {
+  auto rval = Contraption{int(input.at(0).size()), int(input.size())};
+  for (const auto &row : input)
+    rval.cells += row;
+  auto w = rval.width;
+  auto h = rval.height;
+  rval.next.assign(size_t(w * h * 4), edge);
+  auto element = [&](int cell) {
+    return rval.cells[size_t(cell)] != '.' ? cell : edge;
+  };
+  for (auto y = 0; y < h; ++y) {
+    for (auto x = 1; x < w; ++x) {
+      auto cell = y * w + x;
+      auto seen = element(cell - 1);
+      rval.next[size_t(cell * 4 + 2)] = seen != edge ? seen : rval.next[size_t((cell - 1) * 4 + 2)];
     }
-    if (beam.dir == P::right && beam.pos.x >= 0) {
-      if (contraption.contains(beam.pos) && contraption.at(beam.pos) & Dir::RIGHT)
-        continue;
-      contraption[beam.pos] |= Dir::RIGHT;
+    for (auto x = w - 2; x >= 0; --x) {
+      auto cell = y * w + x;
+      auto seen = element(cell + 1);
+      rval.next[size_t(cell * 4 + 3)] = seen != edge ? seen : rval.next[size_t((cell + 1) * 4 + 3)];
     }
-    if (beam.dir == P::up && beam.pos.y < height) {
-      if (contraption.contains(beam.pos) && contraption.at(beam.pos) & Dir::UP)
-        continue;
-      contraption[beam.pos] |= Dir::UP;
+  }
+  for (auto x = 0; x < w; ++x) {
+    for (auto y = 1; y < h; ++y) {
+      auto cell = y * w + x;
+      auto seen = element(cell - w);
+      rval.next[size_t(cell * 4)] = seen != edge ? seen : rval.next[size_t((cell - w) * 4)];
     }
-    if (beam.dir == P::down && beam.pos.y >= 0) {
-      if (contraption.contains(beam.pos) && contraption.at(beam.pos) & Dir::DOWN)
-        continue;
-      contraption[beam.pos] |= Dir::DOWN;
+    for (auto y = h - 2; y >= 0; --y) {
+      auto cell = y * w + x;
+      auto seen = element(cell + w);
+      rval.next[size_t(cell * 4 + 1)] = seen != edge ? seen : rval.next[size_t((cell + w) * 4 + 1)];
     }
+  }
+  return rval;
+}
 
-    auto next = beam.dir + beam.pos;
-
-    if (next.x < 0 || next.y < 0 || next.x >= width || next.y >= height)
-      continue;
+auto fill(std::vector<uint64_t> &bits, size_t begin, size_t end) {
+  while (begin < end) {
+    auto count = std::min(end - begin, 64 - begin % 64);
+    auto mask = count == 64 ? ~uint64_t{} : ((uint64_t{1} << count) - 1) << (begin % 64);
+    bits[begin / 64] |= mask;
+    begin += count;
+  }
+}
 
-    if (input.at(next.y).at(next.x) == '.') {
-      beams.push_back({next, beam.dir});
-      continue;
-    }
+// Outgoing directions for a beam arriving at an element travelling in d.
+auto deflect(char element, int d) -> std::array<int, 2> {
+  switch (element) {
+  case '/':
+    return {std::array{3, 2, 1, 0}[size_t(d)], edge};
+  case '\\':
+    return {std::array{2, 3, 0, 1}[size_t(d)], edge};
+  case '-':
+    return d >= 2 ? std::array{d, edge} : std::array{2, 3};
+  case '|':
+    return d < 2 ? std::array{d, edge} : std::array{0, 1};
+  default:
+    throw std::runtime_error{"lost track of beam?"};
+  }
+}
 
-    if (input.at(next.y).at(next.x) == '/') {
-      if (beam.dir == P::right)
-        beams.push_back({next, P::up});
-      else if (beam.dir == P::left)
-        beams.push_back({next, P::down});
-      else if (beam.dir == P::up)
-        beams.push_back({next, P::right});
-      else if (beam.dir == P::down)
-        beams.push_back({next, P::left});
-      continue;
+// Mark the straight run leaving from in direction d, up to and including the
+// next element or the last cell before the edge, in a row-major bitmap. Returns
+// the element reached, or edge. Horizontal runs are one range fill; vertical
+// ones a bit per row.
+auto mark_run(std::vector<uint64_t> &bits, const Contraption &c, int from, int d, bool inclusive) {
+  auto to = c.next[size_t(from * 4 + d)];
+  auto step = std::array{-c.width, c.width, -1, 1}[size_t(d)];
+  auto x = from % c.width;
+  auto y = from / c.width;
+  auto end = to;
+  if (end == edge)
+    end = d == 0   ? x
+          : d == 1 ? (c.height - 1) * c.width + x
+          : d == 2 ? y * c.width
+                   : y * c.width + c.width - 1;
+  if (!inclusive && from == end)
+    return to;
+  auto begin = inclusive ? from : from + step;
+  if (d >= 2) {
+    auto [lo, hi] = std::minmax(begin, end);
+    fill(bits, size_t(lo), size_t(hi) + 1);
+  } else {
+    for (auto cell = begin;; cell += step) {
+      fill(bits, size_t(cell), size_t(cell) + 1);
+      if (cell == end)
+        break;
     }
+  }
+  return to;
+}
 
-    if (input.at(next.y).at(next.x) == '\\') {
-      if (beam.dir == P::right)
-        beams.push_back({next, P::down});
-      else if (beam.dir == P::left)
-        beams.push_back({next, P::up});
-      else if (beam.dir == P::up)
-        beams.push_back({next, P::left});
-      else if (beam.dir == P::down)
-        beams.push_back({next, P::right});
-      continue;
-    }
+// Beams only ever stop at optical elements: each straight run between them is
+// marked in one row-major bitmap, with per-element direction bits as the
+// visited set.
+auto energise(const Contraption &c, const Beam &origin) {
+  auto cells = c.cells.size();
+  auto energised = std::vector<uint64_t>((cells + 63) / 64);
+  auto visited = std::vector<uint8_t>((cells + 1) / 2);
 
-    if (input.at(next.y).at(next.x) == '-') {
-      if (beam.dir == P::right || beam.dir == P::left)
-        beams.push_back({next, beam.dir});
-      else {
-        beams.push_back({next, P::left});
-        beams.push_back({next, P::right});
-      }
-      continue;
-    }
+  auto pending = std::vector<std::pair<int, int>>{};
+  auto start = origin.pos + origin.dir;
+  auto d = dir_index(origin.dir);
+  auto first = start.y * c.width + start.x;
+  if (c.cells[size_t(first)] != '.')
+    pending.push_back({first, d});
+  else if (auto to = mark_run(energised, c, first, d, true); to != edge)
+    pending.push_back({to, d});
 
-    if (input.at(next.y).at(next.x) == '|') {
-      if (beam.dir == P::up || beam.dir == P::down)
-        beams.push_back({next, beam.dir});
-      else {
-        beams.push_back({next, P::up});
-        beams.push_back({next, P::down});
-      }
+  while (!pending.empty()) {
+    auto [cell, dir] = pending.back();
+    pending.pop_back();
+    auto shift = (cell % 2) * 4;
+    auto &seen = visited[size_t(cell / 2)];
+    if ((seen >> shift) & dir_bit[size_t(dir)])
       continue;
-    }
-
-    throw std::runtime_error{"lost track of beam?"};
+    seen = uint8_t(seen | (dir_bit[size_t(dir)] << shift));
+    fill(energised, size_t(cell), size_t(cell) + 1);
+    for (auto out : deflect(c.cells[size_t(cell)], dir))
+      if (out != edge)
+        if (auto to = mark_run(energised, c, cell, out, false); to != edge)
+          pending.push_back({to, out});
   }
-  return contraption.size();
+  return size_t(std::accumulate(energised.begin(), energised.end(), 0, [](int a, uint64_t word) {
+    return a + std::popcount(word);
+  }));
 }
 
-auto part1(const Parse &input) {
+auto part1(const Contraption &input) {
   return energise(input, {{-1, 0}, P::right});
 }
 
-auto part2(const Parse &input) {
+auto part2(const Contraption &input) {
   auto futures = std::vector<std::future<size_t>>{};
   futures.push_back(std::async([&]() {
     auto rval = size_t{};
-    for (auto x = 0; x < int(input.at(0).size()); ++x)
-      rval = std::max(rval, energise(input, {{x, int(input.size())}, P::up}));
+    for (auto x = 0; x < input.width; ++x)
+      rval = std::max(rval, energise(input, {{x, input.height}, P::up}));
     return rval;
   }));
   futures.push_back(std::async([&]() {
     auto rval = size_t{};
-    for (auto x = 0; x < int(input.at(0).size()); ++x)
+    for (auto x = 0; x < input.width; ++x)
       rval = std::max(rval, energise(input, {{x, -1}, P::down}));
     return rval;
   }));
   futures.push_back(std::async([&]() {
     auto rval = size_t{};
-    for (auto y = 0; y < int(input.size()); ++y)
-      rval = std::max(rval, energise(input, {{int(input.at(0).size())}, P::left}));
+    for (auto y = 0; y < input.height; ++y)
+      rval = std::max(rval, energise(input, {{input.width, y}, P::left}));
     return rval;
   }));
   futures.push_back(std::async([&]() {
     auto rval = size_t{};
-    for (auto y = 0; y < int(input.size()); ++y)
+    for (auto y = 0; y < input.height; ++y)
       rval = std::max(rval, energise(input, {{-1, y}, P::right}));
     return rval;
   }));
@@ -154,12 +213,190 @@ auto part2(const Parse &input) {
   });
 }
 
+// Every beam state (element, direction of arrival) is a node and every
+// straight run an edge. Strongly connected components share one energised set,
+// built as a bitset union in reverse topological order, so each edge start is
+// answered from the component it enters. Bitsets are reference counted by
+// their consumers, so only the live frontier of the order is kept.
+auto part2_condensed(const Contraption &c) {
+  auto elements = std::vector<int>{};
+  auto element_of = std::vector<int>(c.cells.size(), edge);
+  for (auto cell = 0; cell < int(c.cells.size()); ++cell)
+    if (c.cells[size_t(cell)] != '.') {
+      element_of[size_t(cell)] = int(elements.size());
+      elements.push_back(cell);
+    }
+  auto nodes = elements.size() * 4;
+  auto successors = std::vector<std::vector<int>>(nodes);
+  for (auto node = size_t{}; node < nodes; ++node) {
+    auto cell = elements[node / 4];
+    for (auto out : deflect(c.cells[size_t(cell)], int(node % 4)))
+      if (out != edge)
+        if (auto to = c.next[size_t(cell * 4 + out)]; to != edge)
+          successors[node].push_back(element_of[size_t(to)] * 4 + out);
+  }
+
+  // Iterative Tarjan; components come out sinks first.
+  auto index = std::vector<int>(nodes, -1);
+  auto low = std::vector<int>(nodes);
+  auto component = std::vector<int>(nodes, -1);
+  auto stack = std::vector<int>{};
+  auto members = std::vector<std::vector<int>>{};
+  auto counter = 0;
+  for (auto root = 0; root < int(nodes); ++root) {
+    if (index[size_t(root)] != -1)
+      continue;
+    auto calls = std::vector<std::pair<int, size_t>>{{root, 0}};
+    index[size_t(root)] = low[size_t(root)] = counter++;
+    stack.push_back(root);
+    while (!calls.empty()) {
+      auto &[node, edge_index] = calls.back();
+      if (edge_index < successors[size_t(node)].size()) {
+        auto next = successors[size_t(node)][edge_index++];
+        if (index[size_t(next)] == -1) {
+          index[size_t(next)] = low[size_t(next)] = counter++;
+          stack.push_back(next);
+          calls.push_back({next, 0});
+        } else if (component[size_t(next)] == -1) {
+          low[size_t(node)] = std::min(low[size_t(node)], index[size_t(next)]);
+        }
+        continue;
+      }
+      auto finished = node;
+      calls.pop_back();
+      if (!calls.empty())
+        low[size_t(calls.back().first)] =
+            std::min(low[size_t(calls.back().first)], low[size_t(finished)]);
+      if (low[size_t(finished)] != index[size_t(finished)])
+        continue;
+      auto &scc = members.emplace_back();
+      while (true) {
+        auto member = stack.back();
+        stack.pop_back();
+        component[size_t(member)] = int(members.size()) - 1;
+        scc.push_back(member);
+        if (member == finished)
+          break;
+      }
+    }
+  }
+
+  // Components reached straight from an edge start, and every component
+  // downstream of those, are the only ones whose bitsets are ever read.
+  auto downstream = std::vector<std::vector<int>>(members.size());
+  auto last = std::vector<int>(members.size(), -1);
+  for (auto k = 0; k < int(members.size()); ++k)
+    for (auto node : members[size_t(k)])
+      for (auto next : successors[size_t(node)])
+        if (auto other = component[size_t(next)]; other != k && last[size_t(other)] != k) {
+          last[size_t(other)] = k;
+          downstream[size_t(k)].push_back(other);
+        }
+
+  auto origins = std::vector<Beam>{};
+  for (auto x = 0; x < c.width; ++x) {
+    origins.push_back({{x, c.height}, P::up});
+    origins.push_back({{x, -1}, P::down});
+  }
+  for (auto y = 0; y < c.height; ++y) {
+    origins.push_back({{c.width, y}, P::left});
+    origins.push_back({{-1, y}, P::right});
+  }
+  auto entering = std::vector<std::vector<size_t>>(members.size());
+  auto unentered = std::vector<size_t>{};
+  auto needed = std::vector<bool>(members.size());
+  auto refs = std::vector<int>(members.size());
+  auto pending = std::vector<int>{};
+  for (auto i = size_t{}; i < origins.size(); ++i) {
+    auto start = origins[i].pos + origins[i].dir;
+    auto d = dir_index(origins[i].dir);
+    auto first = start.y * c.width + start.x;
+    auto entry = c.cells[size_t(first)] != '.' ? first : c.next[size_t(first * 4 + d)];
+    if (entry == edge) {
+      unentered.push_back(i);
+      continue;
+    }
+    auto k = component[size_t(element_of[size_t(entry)] * 4 + d)];
+    entering[size_t(k)].push_back(i);
+    ++refs[size_t(k)];
+    if (!needed[size_t(k)]) {
+      needed[size_t(k)] = true;
+      pending.push_back(k);
+    }
+  }
+  while (!pending.empty()) {
+    auto k = pending.back();
+    pending.pop_back();
+    for (auto other : downstream[size_t(k)]) {
+      ++refs[size_t(other)];
+      if (!needed[size_t(other)]) {
+        needed[size_t(other)] = true;
+        pending.push_back(other);
+      }
+    }
+  }
+
+  // Components come out sinks first, so every consumer of a bitset is built
+  // after it; each bitset is freed once its last consumer has read it.
+  auto words = (c.cells.size() + 63) / 64;
+  auto energised = std::vector<std::vector<uint64_t>>(members.size());
+  auto release = [&](int k) {
+    if (--refs[size_t(k)] == 0)
+      std::vector<uint64_t>{}.swap(energised[size_t(k)]);
+  };
+  auto scratch = std::vector<uint64_t>(words);
+  auto from_edge = [&](size_t i, const std::vector<uint64_t> *reached) {
+    auto start = origins[i].pos + origins[i].dir;
+    auto d = dir_index(origins[i].dir);
+    auto first = start.y * c.width + start.x;
+    if (reached)
+      scratch = *reached;
+    else
+      std::fill(scratch.begin(), scratch.end(), 0);
+    if (c.cells[size_t(first)] == '.')
+      mark_run(scratch, c, first, d, true);
+    return size_t(std::accumulate(scratch.begin(), scratch.end(), 0, [](int a, uint64_t word) {
+      return a + std::popcount(word);
+    }));
+  };
+
+  auto rval = size_t{};
+  for (auto i : unentered)
+    rval = std::max(rval, from_edge(i, nullptr));
+  for (auto k = 0; k < int(members.size()); ++k) {
+    if (!needed[size_t(k)])
+      continue;
+    auto &bits = energised[size_t(k)];
+    bits.assign(words, 0);
+    for (auto node : members[size_t(k)]) {
+      auto cell = elements[size_t(node) / 4];
+      fill(bits, size_t(cell), size_t(cell) + 1);
+      for (auto out : deflect(c.cells[size_t(cell)], node % 4))
+        if (out != edge)
+          mark_run(bits, c, cell, out, false);
+    }
+    for (auto other : downstream[size_t(k)]) {
+      const auto &reached = energised[size_t(other)];
+      for (auto w = size_t{}; w < words; ++w)
+        bits[w] |= reached[w];
+      release(other);
+    }
+    for (auto i : entering[size_t(k)]) {
+      rval = std::max(rval, from_edge(i, &bits));
+      release(k);
+    }
+  }
+  return rval;
+}
+
 } // namespace
 
-auto main() -> int {
+auto main(int argc, char **argv) -> int {
   BOOST_LOG_TRIVIAL(debug) << "Starting up";
-  auto input = parse("input/16.txt");
+  auto input = build(parse("input/16.txt"));
   BOOST_LOG_TRIVIAL(debug) << "Input parsed";
   BOOST_LOG_TRIVIAL(info) << "Part 1: " << part1(input); // 8034
-  BOOST_LOG_TRIVIAL(info) << "Part 2: " << part2(input); // 8225
+  auto condensed = argc > 1 && std::string_view{argv[1]} == "--scc";
+  BOOST_LOG_TRIVIAL(info) << "Part 2: "
+                          << (condensed ? part2_condensed(input) : part2(input)); // 8225
 }
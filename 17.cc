@@ -1,88 +1,440 @@
+#include "parallel.h"
 #include "parsing.h"
-#include <bitset>
+#include "point.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
-#include <queue>
+#include <future>
+#include <limits>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 namespace {
 
-auto dirs = std::vector<Point>{P::right, P::down, P::left, P::up};
+// Heat losses flattened row-major, with running sums along every row and
+// column so that the cost of any straight run is one subtraction.
+struct Factory {
+  int width{};
+  int height{};
+  std::vector<uint8_t> heat{};
+  std::vector<uint32_t> row_sums{};
+  std::vector<uint32_t> col_sums{};
 
-using Map = std::unordered_map<Point, int>;
-
-using Factory = NumericMap<int>;
+  auto row_cost(int y, int from, int to) const {
+    return row_sums[size_t(y * (width + 1) + to)] - row_sums[size_t(y * (width + 1) + from)];
+  }
+  auto col_cost(int x, int from, int to) const {
+    return col_sums[size_t(x * (height + 1) + to)] - col_sums[size_t(x * (height + 1) + from)];
+  }
+};
 
 auto parse(const std::string &filename) {
-  auto rval = Factory{};
   auto input_handle = std::ifstream{filename};
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
-  return parse_map(input_handle, char_to_num);
+  auto lines = parse_strings(input_handle);
+  auto rval = Factory{int(lines.at(0).size()), int(lines.size())};
+  for (const auto &line : lines)
+    for (auto c : line)
+      rval.heat.push_back(uint8_t(char_to_num(c)));
+  if (rval.heat.size() != size_t(rval.width * rval.height))
+    throw std::runtime_error{"ragged factory"};
+  rval.row_sums.resize(size_t(rval.height * (rval.width + 1)));
+  rval.col_sums.resize(size_t(rval.width * (rval.height + 1)));
+  for (auto y = 0; y < rval.height; ++y)
+    for (auto x = 0; x < rval.width; ++x) {
+      auto h = rval.heat[size_t(y * rval.width + x)];
+      rval.row_sums[size_t(y * (rval.width + 1) + x + 1)] =
+          rval.row_sums[size_t(y * (rval.width + 1) + x)] + h;
+      rval.col_sums[size_t(x * (rval.height + 1) + y + 1)] =
+          rval.col_sums[size_t(x * (rval.height + 1) + y)] + h;
+    }
+  return rval;
 }
 
-struct Node {
-  int heat;
-  Point pos;
-  int dir;
-};
+// A state is a cell and the axis the crucible arrived along (0 horizontal,
+// 1 vertical); the next run must turn onto the other axis.
+constexpr auto unreached = std::numeric_limits<uint32_t>::max();
 
-auto operator<[[maybe_unused]] (const Node &a, const Node &b) {
-  return a.heat >= b.heat;
+template <typename F>
+auto for_each_run(const Factory &factory, uint32_t state, int mini, int maxi, F f) {
+  auto cell = int(state >> 1);
+  auto axis = int(state & 1);
+  auto x = cell % factory.width;
+  auto y = cell / factory.width;
+  if (axis == 1) {
+    for (auto step = mini; step <= maxi && x + step < factory.width; ++step)
+      f(uint32_t((cell + step) << 1), factory.row_cost(y, x + 1, x + step + 1));
+    for (auto step = mini; step <= maxi && x - step >= 0; ++step)
+      f(uint32_t((cell - step) << 1), factory.row_cost(y, x - step, x));
+  } else {
+    for (auto step = mini; step <= maxi && y + step < factory.height; ++step)
+      f(uint32_t(((cell + step * factory.width) << 1) | 1),
+        factory.col_cost(x, y + 1, y + step + 1));
+    for (auto step = mini; step <= maxi && y - step >= 0; ++step)
+      f(uint32_t(((cell - step * factory.width) << 1) | 1), factory.col_cost(x, y - step, y));
+  }
 }
 
-auto dijkstra(const Factory &factory, int mini, int maxi) {
-  auto unvisited = std::priority_queue<Node>{};
-  auto visited = std::unordered_map<Point, std::bitset<4>>{};
-  unvisited.emplace(0, Point{0, 0}, -1);
-  while (!unvisited.empty()) {
-    auto node = unvisited.top();
-    unvisited.pop();
-
-    if (node.pos.x == factory.width - 1 && node.pos.y == factory.height - 1)
-      return node.heat;
-    if (node.dir != -1) {
-      if (visited[node.pos].test(node.dir))
+// Unconstrained heat loss from every cell to the goal, found by a reverse
+// Dial's search over single steps. No crucible can beat it, so it is an
+// admissible (and consistent) A* heuristic for every configuration.
+auto distances_to_goal(const Factory &factory) {
+  auto cells = size_t(factory.width * factory.height);
+  auto rval = std::vector<uint32_t>(cells, unreached);
+  auto buckets = std::vector<std::vector<uint32_t>>(10);
+  auto pending = size_t{1};
+  rval[cells - 1] = 0;
+  buckets[0] = {uint32_t(cells - 1)};
+  for (auto current = uint32_t{}; pending; ++current) {
+    auto &bucket = buckets[current % buckets.size()];
+    while (!bucket.empty()) {
+      auto cell = bucket.back();
+      bucket.pop_back();
+      --pending;
+      if (rval[cell] != current)
         continue;
-      visited[node.pos].set(node.dir);
+      auto x = int(cell) % factory.width;
+      auto y = int(cell) / factory.width;
+      auto cost = current + factory.heat[cell];
+      auto relax = [&](int nx, int ny) {
+        if (nx < 0 || ny < 0 || nx >= factory.width || ny >= factory.height)
+          return;
+        auto next = size_t(ny * factory.width + nx);
+        if (cost >= rval[next])
+          return;
+        rval[next] = cost;
+        buckets[cost % buckets.size()].push_back(uint32_t(next));
+        ++pending;
+      };
+      relax(x + 1, y);
+      relax(x - 1, y);
+      relax(x, y + 1);
+      relax(x, y - 1);
     }
+  }
+  return rval;
+}
 
-    for (auto d = 0; d < int(dirs.size()); ++d) {
-      if (d != -1 && (d == node.dir || (d + 2) % 4 == node.dir))
+// Dial's algorithm: edge weights are at most 9 * maxi, so a ring of that many
+// buckets plus one, indexed by distance, replaces the heap. Given a heuristic
+// it runs as A*, bucketing by distance plus estimate; a consistent estimate
+// raises that key by at most 18 * maxi per run.
+auto dial(const Factory &factory, int mini, int maxi,
+          const std::vector<uint32_t> *heuristic = nullptr) {
+  auto cells = size_t(factory.width * factory.height);
+  auto target = uint32_t(cells - 1);
+  auto estimate = [heuristic](uint32_t state) {
+    return heuristic ? (*heuristic)[state >> 1] : 0;
+  };
+  auto distance = std::vector<uint32_t>(cells * 2, unreached);
+  auto buckets = std::vector<std::vector<uint32_t>>(size_t((heuristic ? 18 : 9) * maxi + 1));
+  auto pending = size_t{2};
+  distance[0] = distance[1] = 0;
+  buckets[estimate(0) % buckets.size()] = {0, 1};
+  for (auto current = estimate(0); pending; ++current) {
+    auto &bucket = buckets[current % buckets.size()];
+    while (!bucket.empty()) {
+      auto state = bucket.back();
+      bucket.pop_back();
+      --pending;
+      if (distance[state] + estimate(state) != current)
         continue;
-      auto prospective = node.pos;
-      auto p_heat = node.heat;
-      for (auto step = 1; step <= maxi; ++step) {
-        prospective = prospective + dirs.at(d);
-        if (prospective.x < 0 || prospective.y < 0 || prospective.x >= factory.width ||
-            prospective.y >= factory.height)
-          break;
-        p_heat += factory.map.at(prospective);
-        if (step >= mini)
-          unvisited.emplace(p_heat, prospective, d);
-      }
+      if (state >> 1 == target)
+        return distance[state];
+      auto base = distance[state];
+      for_each_run(factory, state, mini, maxi, [&](uint32_t next, uint32_t cost) {
+        if (base + cost >= distance[next])
+          return;
+        distance[next] = base + cost;
+        buckets[(distance[next] + estimate(next)) % buckets.size()].push_back(next);
+        ++pending;
+      });
     }
   }
   throw std::runtime_error{"lost"};
 }
 
-auto part1(const Factory &factory) {
-  return dijkstra(factory, 1, 3);
+struct Crucible {
+  int mini;
+  int maxi;
+};
+
+// Route the configurations on at most one worker per hardware thread, each
+// taking the next unrouted one in turn, so only that many sets of state arrays
+// are live. All of them share one heuristic.
+auto route_all(const Factory &factory, const std::vector<Crucible> &crucibles, bool astar) {
+  auto heuristic = astar ? distances_to_goal(factory) : std::vector<uint32_t>{};
+  auto rval = std::vector<uint32_t>(crucibles.size());
+  auto next = std::atomic<size_t>{};
+  auto futures = std::vector<std::future<void>>{};
+  for (auto worker = size_t{}; worker < std::min(workers(), crucibles.size()); ++worker)
+    futures.push_back(std::async(std::launch::async, [&]() {
+      for (auto i = next++; i < crucibles.size(); i = next++)
+        rval[i] = dial(factory, crucibles[i].mini, crucibles[i].maxi, astar ? &heuristic : nullptr);
+    }));
+  for (auto &future : futures)
+    future.get();
+  return rval;
 }
 
-auto part2(const Factory &factory) {
-  return dijkstra(factory, 4, 10);
+// Compact mode, for factories too large for the flat arrays above. Heat is
+// kept in nibbles and run costs are summed on the fly rather than read from
+// prefix sums. Cells can be grouped into square tiles for locality, so that
+// the search front stays on a few pages; tiling pads the map to whole tiles
+// and saves no memory.
+struct Layout {
+  int width{};
+  int height{};
+  int shift{}; // log2 of the tile side; 0 is plain row-major
+  int tiles_x{};
+
+  Layout() = default;
+  Layout(int w, int h, int s) : width{w}, height{h}, shift{s}, tiles_x{((w - 1) >> s) + 1} {}
+
+  auto cells() const {
+    return size_t(tiles_x) * size_t(((height - 1) >> shift) + 1) << (2 * shift);
+  }
+  auto index(int x, int y) const {
+    auto mask = (1 << shift) - 1;
+    auto tile = size_t((y >> shift) * tiles_x + (x >> shift));
+    return (tile << (2 * shift)) | size_t(((y & mask) << shift) | (x & mask));
+  }
+  auto point(size_t index) const {
+    auto mask = (1 << shift) - 1;
+    auto tile = int(index >> (2 * shift));
+    auto within = int(index & ((size_t{1} << (2 * shift)) - 1));
+    return Point{(tile % tiles_x << shift) | (within & mask),
+                 (tile / tiles_x << shift) | (within >> shift)};
+  }
+};
+
+struct Nibbles {
+  std::vector<uint8_t> data{};
+
+  auto get(size_t i) const {
+    return uint32_t(data[i >> 1] >> ((i & 1) * 4)) & 15;
+  }
+  auto set(size_t i, uint32_t value) {
+    data[i >> 1] = uint8_t(data[i >> 1] | value << ((i & 1) * 4));
+  }
+};
+
+struct CompactFactory {
+  Layout layout{};
+  Nibbles heat{};
+};
+
+// Bytes resident while routing one configuration in compact mode: the heat
+// nibbles, then for both states of every cell a Rel distance and the reached
+// and settled bits. The heap is then held to whatever the budget has left.
+template <typename Rel>
+auto compact_bytes(const Layout &layout) {
+  auto cells = layout.cells();
+  return cells / 2 + 1 + cells * 2 * sizeof(Rel) + cells * 2 * 2 / 8;
+}
+
+// Stream the map straight into nibbles in its final layout, refusing to grow
+// the heat beyond the budget.
+auto parse_compact(const std::string &filename, bool tiled, size_t budget) {
+  auto input_handle = std::ifstream{filename};
+  if (!input_handle)
+    throw std::runtime_error{"could not open file"};
+  auto rval = CompactFactory{};
+  auto line = std::string{};
+  auto width = 0;
+  auto height = 0;
+  while (std::getline(input_handle, line)) {
+    if (line.empty())
+      continue;
+    if (height && int(line.size()) != width)
+      throw std::runtime_error{"ragged factory"};
+    width = int(line.size());
+    rval.layout = Layout{width, ++height, tiled ? 6 : 0};
+    if (rval.layout.cells() / 2 + 1 > budget)
+      throw std::runtime_error{"over memory budget"};
+    rval.heat.data.resize(rval.layout.cells() / 2 + 1);
+    for (auto x = 0; x < width; ++x) {
+      auto c = line[size_t(x)];
+      if (c < '0' || c > '9')
+        throw std::runtime_error{"bad heat loss"};
+      rval.heat.set(rval.layout.index(x, height - 1), uint32_t(char_to_num(c)));
+    }
+  }
+  if (!height)
+    throw std::runtime_error{"empty factory"};
+  if (rval.layout.cells() * 2 > std::numeric_limits<uint32_t>::max())
+    throw std::runtime_error{"factory too large"};
+  return rval;
+}
+
+template <typename F>
+auto for_each_compact_run(const CompactFactory &factory, uint32_t state, int mini, int maxi, F f) {
+  const auto &layout = factory.layout;
+  auto here = layout.point(state >> 1);
+  auto axis = state & 1;
+  for (auto delta : axis ? std::array{P::left, P::right} : std::array{P::up, P::down}) {
+    auto p = here;
+    auto cost = uint32_t{};
+    for (auto step = 1; step <= maxi; ++step) {
+      p += delta;
+      if (p.x < 0 || p.y < 0 || p.x >= layout.width || p.y >= layout.height)
+        break;
+      auto index = layout.index(p.x, p.y);
+      cost += factory.heat.get(index);
+      if (step >= mini)
+        f(uint32_t(index << 1) | (axis ^ 1), cost);
+    }
+  }
+}
+
+// Monotone priority queue of packed (key << 32 | state) entries: bucket b
+// holds keys whose highest bit differing from the last key popped is b - 1.
+// Buckets grow by explicit doubling, so the entries allocated across all of
+// them never exceed limit.
+struct RadixHeap {
+  std::array<std::vector<uint64_t>, 33> buckets{};
+  uint32_t last{};
+  size_t size{};
+  size_t reserved{};
+  size_t limit = std::numeric_limits<size_t>::max();
+
+  static auto bucket_for(uint32_t key, uint32_t last) {
+    return size_t(std::bit_width(key ^ last));
+  }
+  auto put(uint64_t entry) {
+    auto &bucket = buckets[bucket_for(uint32_t(entry >> 32), last)];
+    if (bucket.size() == bucket.capacity()) {
+      auto grown = std::max(size_t{16}, bucket.capacity() * 2);
+      if (reserved - bucket.capacity() + grown > limit)
+        throw std::runtime_error{"over memory budget"};
+      reserved += grown - bucket.capacity();
+      bucket.reserve(grown);
+    }
+    bucket.push_back(entry);
+  }
+  auto push(uint32_t key, uint32_t state) {
+    put(uint64_t{key} << 32 | state);
+    ++size;
+  }
+  // Returns the state; its key is left in last.
+  auto pop() {
+    if (buckets[0].empty()) {
+      auto b = size_t{1};
+      while (buckets[b].empty())
+        ++b;
+      last = uint32_t(*std::min_element(buckets[b].begin(), buckets[b].end()) >> 32);
+      for (auto entry : buckets[b])
+        put(entry);
+      buckets[b].clear();
+    }
+    auto entry = buckets[0].back();
+    buckets[0].pop_back();
+    --size;
+    return uint32_t(entry);
+  }
+};
+
+// Every unsettled state that has been reached lies within 9 * maxi of the
+// key being popped, so only its distance modulo the width of Rel is kept.
+template <typename Rel>
+auto route_compact(const CompactFactory &factory, int mini, int maxi, size_t budget) {
+  const auto &layout = factory.layout;
+  auto needed = compact_bytes<Rel>(layout);
+  BOOST_LOG_TRIVIAL(debug) << "Routing " << mini << '-' << maxi << " needs " << (needed >> 20)
+                           << " MiB";
+  if (needed > budget)
+    throw std::runtime_error{"over memory budget"};
+  auto states = layout.cells() * 2;
+  auto target = layout.index(layout.width - 1, layout.height - 1);
+  auto distance = std::vector<Rel>(states);
+  auto reached = std::vector<bool>(states);
+  auto settled = std::vector<bool>(states);
+  auto heap = RadixHeap{};
+  heap.limit = (budget - needed) / sizeof(uint64_t);
+  for (auto axis : {0u, 1u}) {
+    reached[axis] = true;
+    heap.push(0, axis);
+  }
+  while (heap.size) {
+    auto state = heap.pop();
+    if (settled[state])
+      continue;
+    settled[state] = true;
+    auto current = heap.last;
+    if (state >> 1 == target)
+      return current;
+    for_each_compact_run(factory, state, mini, maxi, [&](uint32_t next, uint32_t cost) {
+      if (settled[next])
+        return;
+      auto candidate = current + cost;
+      if (reached[next] && current + Rel(distance[next] - Rel(current)) <= candidate)
+        return;
+      distance[next] = Rel(candidate);
+      reached[next] = true;
+      heap.push(candidate, next);
+    });
+  }
+  throw std::runtime_error{"lost"};
+}
+
+auto route_compact(const CompactFactory &factory, int mini, int maxi, size_t budget) {
+  if (9 * maxi < 256)
+    return route_compact<uint8_t>(factory, mini, maxi, budget);
+  if (9 * maxi < 65536)
+    return route_compact<uint16_t>(factory, mini, maxi, budget);
+  throw std::runtime_error{"crucible too long"};
 }
 
 } // namespace
 
-auto main() -> int {
+auto main(int argc, char **argv) -> int {
   BOOST_LOG_TRIVIAL(debug) << "Starting up";
+  auto astar = false;
+  auto compact = false;
+  auto tiled = false;
+  auto budget = std::numeric_limits<size_t>::max();
+  auto crucibles = std::vector<Crucible>{{1, 3}, {4, 10}};
+  for (auto i = 1; i < argc; ++i) {
+    auto arg = std::string_view{argv[i]};
+    if (arg == "--astar")
+      astar = true;
+    else if (arg == "--compact")
+      compact = true;
+    else if (arg == "--tiled")
+      tiled = true;
+    else if (arg == "--budget" && i + 1 < argc)
+      budget = std::stoul(argv[++i]) << 20;
+    else if (arg.starts_with("-") || i + 1 == argc)
+      throw std::runtime_error{"usage: 17 [--astar] [--compact [--tiled] [--budget MiB]] "
+                               "[mini maxi]..."};
+    else {
+      crucibles.push_back({std::stoi(argv[i]), std::stoi(argv[i + 1])});
+      ++i;
+    }
+  }
+  if (compact) {
+    // One configuration at a time, so only one set of state arrays is live.
+    auto input = parse_compact("input/17.txt", tiled, budget);
+    BOOST_LOG_TRIVIAL(debug) << "Input parsed";
+    for (auto i = size_t{}; i < crucibles.size(); ++i)
+      BOOST_LOG_TRIVIAL(info) << "Crucible " << crucibles[i].mini << '-' << crucibles[i].maxi
+                              << ": "
+                              << route_compact(input, crucibles[i].mini, crucibles[i].maxi, budget);
+    return 0;
+  }
   auto input = parse("input/17.txt");
   BOOST_LOG_TRIVIAL(debug) << "Input parsed";
-  BOOST_LOG_TRIVIAL(info) << "Part 1: " << part1(input); // 694
-  BOOST_LOG_TRIVIAL(info) << "Part 2: " << part2(input); // 829
+  auto routes = route_all(input, crucibles, astar);
+  BOOST_LOG_TRIVIAL(info) << "Part 1: " << routes[0]; // 694
+  BOOST_LOG_TRIVIAL(info) << "Part 2: " << routes[1]; // 829
+  for (auto i = size_t{2}; i < routes.size(); ++i)
+    BOOST_LOG_TRIVIAL(info) << "Crucible " << crucibles[i].mini << '-' << crucibles[i].maxi
+                            << ": " << routes[i];
 }
@@ -1,94 +1,127 @@
-#include "parsing.h"
-#include <algorithm>
+#include "parallel.h"
+#include "wide.h"
 #include <boost/log/trivial.hpp>
+#include <cstdint>
 #include <fstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace {
 
+// Both readings of an instruction, each packed as distance << 2 | direction
+// with directions numbered as in the colour code: 0 R, 1 D, 2 L, 3 U.
 struct Dig {
-  char direction;
-  int distance;
-  std::string colour;
+  uint32_t plain;
+  uint32_t colour;
 };
 
 using Parse = std::vector<Dig>;
 
+auto hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return uint32_t(c - '0');
+  if (c >= 'a' && c <= 'f')
+    return uint32_t(c - 'a' + 10);
+  throw std::runtime_error{"bad colour"};
+}
+
+auto decode(const std::string &line) {
+  auto direction = std::string_view{"RDLU"}.find(line.at(0));
+  if (direction == std::string_view::npos)
+    throw std::runtime_error{"bad direction"};
+  auto distance = uint32_t{};
+  auto i = size_t{2};
+  for (; i < line.size() && line[i] != ' '; ++i)
+    distance = distance * 10 + uint32_t(line[i] - '0');
+  auto hash = line.find('#', i);
+  if (hash == std::string::npos || hash + 6 >= line.size())
+    throw std::runtime_error{"bad colour"};
+  auto coded = uint32_t{};
+  for (auto j = hash + 1; j < hash + 6; ++j)
+    coded = coded << 4 | hex_digit(line[j]);
+  auto coded_direction = hex_digit(line[hash + 6]);
+  if (coded_direction > 3)
+    throw std::runtime_error{"bad direction"};
+  return Dig{distance << 2 | uint32_t(direction), coded << 2 | coded_direction};
+}
+
 auto parse(const std::string &filename) {
   auto rval = Parse{};
   auto input_handle = std::ifstream{filename};
   if (!input_handle)
     throw std::runtime_error{"could not open file"};
-  auto dir = std::string{};
-  auto dist = int{};
-  auto colour = std::string{};
-  auto ss = std::stringstream{};
-  while (getline(input_handle, ss)) {
-    ss >> dir >> dist >> colour;
-    rval.emplace_back(dir.at(0), dist, colour.substr(2, 6));
-  }
+  auto line = std::string{};
+  while (std::getline(input_handle, line))
+    if (!line.empty())
+      rval.push_back(decode(line));
   return rval;
 }
 
-auto shoelace(const std::vector<Point> &points) {
-  auto area = size_t{};
-  auto perimeter = size_t{};
-  for (auto s = size_t{}; s < points.size(); ++s) {
-    auto &a = points.at(s);
-    auto &b = points.at(s == points.size() - 1 ? 0 : s + 1);
-    area += long(a.x) * b.y - long(b.x) * a.y;
-    perimeter += std::abs(a.x - b.x) + std::abs(a.y - b.y);
-  }
-  return area / 2 + perimeter / 2 + 1; // Pick's
-}
+using Wide = __int128;
 
-struct Part1 {
-  auto operator()(const Point current_position, const Dig &dig) {
-    switch (dig.direction) {
-    case 'R':
-      return Point{current_position.x + dig.distance, current_position.y};
-    case 'D':
-      return Point{current_position.x, current_position.y + dig.distance};
-    case 'L':
-      return Point{current_position.x - dig.distance, current_position.y};
-    case 'U':
-      return Point{current_position.x, current_position.y - dig.distance};
+// The shoelace sum of x * dy over a run of digs taken from the origin, with
+// the run's displacement and length. Runs combine associatively: shifting the
+// second run right by the first's dx adds dx times its own dy to the area.
+struct Trench {
+  int64_t dx{};
+  int64_t dy{};
+  Wide area{};
+  Wide perimeter{};
+
+  auto dig(uint32_t packed) {
+    auto distance = int64_t(packed >> 2);
+    switch (packed & 3) {
+    case 0:
+      dx += distance;
+      break;
+    case 1:
+      area += Wide(dx) * distance;
+      dy += distance;
+      break;
+    case 2:
+      dx -= distance;
+      break;
     default:
-      throw std::runtime_error{"bad direction"};
+      area -= Wide(dx) * distance;
+      dy -= distance;
     }
+    perimeter += distance;
   }
 };
 
-struct Part2 {
-  auto operator()(const Point current_position, const Dig &dig) {
-    auto dist = std::stoi(dig.colour.substr(0, 5), nullptr, 16);
-    switch (dig.colour.at(5)) {
-    case '0':
-      return Point{current_position.x + dist, current_position.y};
-    case '1':
-      return Point{current_position.x, current_position.y + dist};
-    case '2':
-      return Point{current_position.x - dist, current_position.y};
-    case '3':
-      return Point{current_position.x, current_position.y - dist};
-    default:
-      throw std::runtime_error{"bad direction"};
-    }
-  }
+auto operator+(const Trench &a, const Trench &b) {
+  return Trench{a.dx + b.dx, a.dy + b.dy, a.area + b.area + Wide(a.dx) * b.dy,
+                a.perimeter + b.perimeter};
+}
+
+struct Lagoon {
+  Trench plain{};
+  Trench colour{};
 };
 
-template <class Digger>
-auto measure_dig(const Parse &input) {
-  auto current_position = Point{};
-  auto dug = std::vector<Point>{};
-  dug.reserve(input.size() + 1);
-  dug.push_back(current_position);
-  auto digger = Digger{};
-  for (auto &dig : input)
-    dug.push_back(digger(dug.back(), dig));
-  return shoelace(dug);
+auto operator+(const Lagoon &a, const Lagoon &b) {
+  return Lagoon{a.plain + b.plain, a.colour + b.colour};
+}
+
+// Both plans trace in one pass over each chunk; the chunks fold in order.
+auto survey(const Parse &input) {
+  return parallel_fold(input.size(), Lagoon{}, [&input](size_t begin, size_t end) {
+    auto rval = Lagoon{};
+    for (auto i = begin; i < end; ++i) {
+      rval.plain.dig(input[i].plain);
+      rval.colour.dig(input[i].colour);
+    }
+    return rval;
+  });
+}
+
+auto capacity(const Trench &trench) {
+  if (trench.dx || trench.dy)
+    throw std::runtime_error{"trench does not close"};
+  auto area = trench.area < 0 ? -trench.area : trench.area;
+  return area + trench.perimeter / 2 + 1; // Pick's
 }
 
 } // namespace
@@ -97,6 +130,7 @@ auto main() -> int {
   BOOST_LOG_TRIVIAL(debug) << "Starting up";
   auto input = parse("input/18.txt");
   BOOST_LOG_TRIVIAL(debug) << "Input parsed";
-  BOOST_LOG_TRIVIAL(info) << "Part 1: " << measure_dig<Part1>(input); // 46334
-  BOOST_LOG_TRIVIAL(info) << "Part 2: " << measure_dig<Part2>(input); // 102000662718092
+  auto lagoon = survey(input);
+  BOOST_LOG_TRIVIAL(info) << "Part 1: " << to_string(capacity(lagoon.plain));  // 46334
+  BOOST_LOG_TRIVIAL(info) << "Part 2: " << to_string(capacity(lagoon.colour)); // 102000662718092
 }
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <thread>
+#include <vector>
+
+inline auto workers() {
+  return std::max(size_t{1}, size_t{std::thread::hardware_concurrency()});
+}
+
+// Splits [0, size) into one range per hardware thread, runs chunk(begin, end)
+// on each concurrently, and folds the results with + in order, so the
+// combination only needs to be associative.
+template <typename T, typename F>
+auto parallel_fold(size_t size, T init, F chunk) {
+  auto threads = workers();
+  auto step = std::max(size_t{1}, (size + threads - 1) / threads);
+  auto futures = std::vector<std::future<T>>{};
+  for (auto begin = size_t{}; begin < size; begin += step) {
+    auto end = std::min(begin + step, size);
+    futures.push_back(std::async(std::launch::async, [&chunk, begin, end]() {
+      return chunk(begin, end);
+    }));
+  }
+  for (auto &future : futures)
+    init = init + future.get();
+  return init;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+// The standard library has no formatting for 128-bit integers.
+inline auto to_string(unsigned __int128 value) {
+  auto rval = std::string{};
+  do {
+    rval.insert(rval.begin(), char('0' + int(value % 10)));
+    value /= 10;
+  } while (value);
+  return rval;
+}
+
+inline auto to_string(__int128 value) {
+  if (value < 0)
+    return '-' + to_string(-static_cast<unsigned __int128>(value));
+  return to_string(static_cast<unsigned __int128>(value));
+}